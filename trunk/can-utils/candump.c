@@ -59,6 +59,7 @@
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/uio.h>
+#include <sys/mman.h>
 #include <net/if.h>
 
 #include <linux/can.h>
@@ -95,6 +96,10 @@ static __u32 last_dropcnt[MAXSOCK];
 static char devname[MAXIFNAMES][IFNAMSIZ+1];
 static int  dindex[MAXIFNAMES];
 static int  max_devname_len; /* to prevent frazzled device name output */ 
+static struct can_raw_ring_slot *rxring[MAXSOCK];
+static int rxring_tail[MAXSOCK];
+static int ringslots;
+static unsigned char dropmonitor;
 
 #define MAXANI 4
 const char anichar[MAXANI] = {'|', '/', '-', '\\'};
@@ -120,6 +125,9 @@ void print_usage(char *prg)
 	fprintf(stderr, "         -L          (use log file format on stdout)\n");
 	fprintf(stderr, "         -n <count>  (terminate after receiption of <count> CAN frames)\n");
 	fprintf(stderr, "         -r <size>   (set socket receive buffer to <size>)\n");
+	fprintf(stderr, "         -m <frames> (receive up to <frames> CAN frames with one read)\n");
+	fprintf(stderr, "         -M <slots>  (receive via mmap'ed rx ring with <slots> CAN frames)\n");
+	fprintf(stderr, "         -F <frames> (share rx ring of <frames> CAN frames with identical filters)\n");
 	fprintf(stderr, "         -d          (monitor dropped CAN frames)\n");
 	fprintf(stderr, "         -e          (dump CAN error frames in human-readable format)\n");
 	fprintf(stderr, "\n");
@@ -197,6 +205,40 @@ int idx2dindex(int ifidx, int socket) {
 	return i;
 }
 
+static inline int ring_ready(int i)
+{
+	volatile __u32 *status = &rxring[i][rxring_tail[i]].status;
+
+	return *status == CAN_RAW_SLOT_USER;
+}
+
+/* copy up to max frames from the rx ring of socket i and release the slots */
+int ring_fetch(int i, struct can_raw_batch_frame *bframes, int max)
+{
+	struct can_raw_ring_slot *slot;
+	int n = 0;
+
+	while (n < max && ring_ready(i)) {
+
+		slot = &rxring[i][rxring_tail[i]];
+
+		__sync_synchronize(); /* read status before the slot content */
+
+		bframes[n++] = slot->bf;
+		if (dropmonitor)
+			dropcnt[i] = slot->drops;
+
+		__sync_synchronize(); /* read slot content before release */
+
+		*(volatile __u32 *)&slot->status = CAN_RAW_SLOT_KERNEL;
+
+		if (++rxring_tail[i] >= ringslots)
+			rxring_tail[i] = 0;
+	}
+
+	return n;
+}
+
 int main(int argc, char **argv)
 {
 	fd_set rdfs;
@@ -204,7 +246,6 @@ int main(int argc, char **argv)
 	int bridge = 0;
 	useconds_t bridge_delay = 0;
 	unsigned char timestamp = 0;
-	unsigned char dropmonitor = 0;
 	unsigned char silent = SILENT_INI;
 	unsigned char silentani = 0;
 	unsigned char color = 0;
@@ -213,6 +254,10 @@ int main(int argc, char **argv)
 	unsigned char logfrmt = 0;
 	int count = 0;
 	int rcvbuf_size = 0;
+	int batch = 0;
+	int fanout = 0;
+	int pending;
+	size_t ringsize = 0;
 	int opt, ret;
 	int currmax, numfilter;
 	char *ptr, *nptr;
@@ -224,6 +269,7 @@ int main(int argc, char **argv)
 	struct can_filter *rfilter;
 	can_err_mask_t err_mask;
 	struct can_frame frame;
+	struct can_raw_batch_frame *bframes = NULL;
 	int nbytes, i;
 	struct ifreq ifr;
 	struct timeval tv, last_tv;
@@ -236,7 +282,7 @@ int main(int argc, char **argv)
 	last_tv.tv_sec  = 0;
 	last_tv.tv_usec = 0;
 
-	while ((opt = getopt(argc, argv, "t:ciaSs:b:B:u:ldLn:r:he?")) != -1) {
+	while ((opt = getopt(argc, argv, "t:ciaSs:b:B:u:ldLn:r:m:M:F:he?")) != -1) {
 		switch (opt) {
 		case 't':
 			timestamp = optarg[0];
@@ -347,6 +393,30 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'm':
+			batch = atoi(optarg);
+			if (batch < 1) {
+				print_usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+
+		case 'M':
+			ringslots = atoi(optarg);
+			if (ringslots < 1) {
+				print_usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+
+		case 'F':
+			fanout = atoi(optarg);
+			if (fanout < 1) {
+				print_usage(basename(argv[0]));
+				exit(1);
+			}
+			break;
+
 		default:
 			print_usage(basename(argv[0]));
 			exit(1);
@@ -372,6 +442,32 @@ int main(int argc, char **argv)
 			silent = SILENT_OFF; /* default output */
 	}
 
+	if (ringslots && fanout) {
+		fprintf(stderr, "The options -M and -F can not be combined.\n");
+		print_usage(basename(argv[0]));
+		exit(1);
+	}
+
+	if (ringslots) {
+		long pagesize = sysconf(_SC_PAGESIZE);
+
+		/* the rx ring is mapped in multiples of the page size */
+		ringsize = ringslots * sizeof(struct can_raw_ring_slot);
+		ringsize = (ringsize + pagesize - 1) / pagesize * pagesize;
+
+		/* frames are fetched from the ring into the batch buffer */
+		if (!batch)
+			batch = ringslots;
+	}
+
+	if (batch) {
+		bframes = malloc(batch * sizeof(*bframes));
+		if (!bframes) {
+			fprintf(stderr, "Failed to create batch receive space!\n");
+			return 1;
+		}
+	}
+
 	currmax = argc - optind; /* find real number of CAN devices */
 
 	if (currmax > MAXSOCK) {
@@ -536,6 +632,41 @@ int main(int argc, char **argv)
 			}
 		}
 
+		if (ringslots) {
+			struct can_raw_ring_req req;
+
+			req.slot_nr = ringslots;
+			req.drops = 0;
+
+			if (setsockopt(s[i], SOL_CAN_RAW, CAN_RAW_RX_RING,
+				       &req, sizeof(req)) < 0) {
+				perror("setsockopt CAN_RAW_RX_RING not supported by your Linux Kernel");
+				return 1;
+			}
+
+			rxring[i] = mmap(NULL, ringsize, PROT_READ | PROT_WRITE,
+					 MAP_SHARED, s[i], 0);
+			if (rxring[i] == MAP_FAILED) {
+				perror("mmap");
+				return 1;
+			}
+		} else if (batch) {
+			if (setsockopt(s[i], SOL_CAN_RAW, CAN_RAW_RECV_BATCH,
+				       &batch, sizeof(batch)) < 0) {
+				perror("setsockopt CAN_RAW_RECV_BATCH not supported by your Linux Kernel");
+				return 1;
+			}
+		}
+
+		/* needs to be set before bind() */
+		if (fanout) {
+			if (setsockopt(s[i], SOL_CAN_RAW, CAN_RAW_FANOUT,
+				       &fanout, sizeof(fanout)) < 0) {
+				perror("setsockopt CAN_RAW_FANOUT not supported by your Linux Kernel");
+				return 1;
+			}
+		}
+
 		if (bind(s[i], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
 			perror("bind");
 			return 1;
@@ -575,7 +706,7 @@ int main(int argc, char **argv)
 	}
 
 	/* these settings are static and can be held out of the hot path */
-	iov.iov_base = &frame;
+	iov.iov_base = (batch)?(void *)bframes:(void *)&frame;
 	msg.msg_name = &addr;
 	msg.msg_iov = &iov;
 	msg.msg_iovlen = 1;
@@ -584,62 +715,72 @@ int main(int argc, char **argv)
 	while (running) {
 
 		FD_ZERO(&rdfs);
-		for (i=0; i<currmax; i++)
-			FD_SET(s[i], &rdfs);
+		pending = 0;
+
+		/* check the rx rings first to omit the select() syscall */
+		if (ringslots) {
+			for (i=0; i<currmax; i++) {
+				if (ring_ready(i)) {
+					FD_SET(s[i], &rdfs);
+					pending++;
+				}
+			}
+		}
+
+		if (!pending) {
+			for (i=0; i<currmax; i++)
+				FD_SET(s[i], &rdfs);
 
-		if ((ret = select(s[currmax-1]+1, &rdfs, NULL, NULL, NULL)) < 0) {
-			//perror("select");
-			running = 0;
-			continue;
+			if ((ret = select(s[currmax-1]+1, &rdfs, NULL, NULL, NULL)) < 0) {
+				//perror("select");
+				running = 0;
+				continue;
+			}
 		}
 
 		for (i=0; i<currmax; i++) {  /* check all CAN RAW sockets */
 
 			if (FD_ISSET(s[i], &rdfs)) {
 
-				int idx;
-
-				/* these settings may be modified by recvmsg() */
-				iov.iov_len = sizeof(frame);
-				msg.msg_namelen = sizeof(addr);
-				msg.msg_controllen = sizeof(ctrlmsg);  
-				msg.msg_flags = 0;
-
-				nbytes = recvmsg(s[i], &msg, 0);
-				if (nbytes < 0) {
-					perror("read");
-					return 1;
-				}
-
-				if (nbytes < sizeof(struct can_frame)) {
-					fprintf(stderr, "read: incomplete CAN frame\n");
-					return 1;
-				}
-
-				if (count && (--count == 0))
-					running = 0;
-
-				if (bridge) {
-					if (bridge_delay)
-						usleep(bridge_delay);
-
-					nbytes = write(bridge, &frame, sizeof(struct can_frame));
+				int idx, j, nframes = 1;
+
+				if (ringslots) {
+					/* fetch frames from the mmap'ed rx ring */
+					nframes = ring_fetch(i, bframes, batch);
+					if (!nframes)
+						continue;
+				} else {
+					/* these settings may be modified by recvmsg() */
+					iov.iov_len = (batch)?batch * sizeof(*bframes):sizeof(frame);
+					msg.msg_namelen = sizeof(addr);
+					msg.msg_controllen = sizeof(ctrlmsg);  
+					msg.msg_flags = 0;
+
+					nbytes = recvmsg(s[i], &msg, 0);
 					if (nbytes < 0) {
-						perror("bridge write");
+						perror("read");
 						return 1;
+					}
+
+					if (batch) {
+						if (nbytes < sizeof(*bframes)) {
+							fprintf(stderr, "read: incomplete CAN frame\n");
+							return 1;
+						}
+						nframes = nbytes / sizeof(*bframes);
 					} else if (nbytes < sizeof(struct can_frame)) {
-						fprintf(stderr,"bridge write: incomplete CAN frame\n");
+						fprintf(stderr, "read: incomplete CAN frame\n");
 						return 1;
 					}
-				}
-		    
-				for (cmsg = CMSG_FIRSTHDR(&msg);
-				     cmsg && (cmsg->cmsg_level == SOL_SOCKET);
-				     cmsg = CMSG_NXTHDR(&msg,cmsg)) {
-					if (cmsg->cmsg_type == SO_TIMESTAMP)
-						tv = *(struct timeval *)CMSG_DATA(cmsg);
-					else if (cmsg->cmsg_type == SO_RXQ_OVFL)
-						dropcnt[i] = *(__u32 *)CMSG_DATA(cmsg);
+
+					for (cmsg = CMSG_FIRSTHDR(&msg);
+					     cmsg && (cmsg->cmsg_level == SOL_SOCKET);
+					     cmsg = CMSG_NXTHDR(&msg,cmsg)) {
+						if (cmsg->cmsg_type == SO_TIMESTAMP)
+							tv = *(struct timeval *)CMSG_DATA(cmsg);
+						else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+							dropcnt[i] = *(__u32 *)CMSG_DATA(cmsg);
+					}
 				}
 
 				/* check for (unlikely) dropped frames on this specific socket */
@@ -663,92 +804,124 @@ int main(int argc, char **argv)
 					last_dropcnt[i] = dropcnt[i];
 				}
 
-				idx = idx2dindex(addr.can_ifindex, s[i]);
+				for (j = 0; j < nframes; j++) {
 
-				if (log) {
-					/* log CAN frame with absolute timestamp & device */
-					fprintf(logfile, "(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
-					fprintf(logfile, "%*s ", max_devname_len, devname[idx]);
-					/* without seperator as logfile use-case is parsing */
-					fprint_canframe(logfile, &frame, "\n", 0);
-				}
+					if (batch) {
+						/* take frame and metadata from the array element */
+						frame = bframes[j].frame;
+						tv.tv_sec = bframes[j].tv_sec;
+						tv.tv_usec = bframes[j].tv_usec;
+						addr.can_ifindex = bframes[j].ifindex;
+					}
 
-				if (logfrmt) {
-					/* print CAN frame in log file style to stdout */
-					printf("(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
-					printf("%*s ", max_devname_len, devname[idx]);
-					fprint_canframe(stdout, &frame, "\n", 0);
-					goto out_fflush; /* no other output to stdout */
-				}
+					if (count && (--count == 0)) {
+						running = 0;
+						nframes = j + 1; /* omit further frames */
+					}
 
-				if (silent != SILENT_OFF){
-					if (silent == SILENT_ANI) {
-						printf("%c\b", anichar[silentani%=MAXANI]);
-						silentani++;
+					if (bridge) {
+						if (bridge_delay)
+							usleep(bridge_delay);
+
+						nbytes = write(bridge, &frame, sizeof(struct can_frame));
+						if (nbytes < 0) {
+							perror("bridge write");
+							return 1;
+						} else if (nbytes < sizeof(struct can_frame)) {
+							fprintf(stderr,"bridge write: incomplete CAN frame\n");
+							return 1;
+						}
+					}
+		    
+					idx = idx2dindex(addr.can_ifindex, s[i]);
+
+					if (log) {
+						/* log CAN frame with absolute timestamp & device */
+						fprintf(logfile, "(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
+						fprintf(logfile, "%*s ", max_devname_len, devname[idx]);
+						/* without seperator as logfile use-case is parsing */
+						fprint_canframe(logfile, &frame, "\n", 0);
+					}
+
+					if (logfrmt) {
+						/* print CAN frame in log file style to stdout */
+						printf("(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
+						printf("%*s ", max_devname_len, devname[idx]);
+						fprint_canframe(stdout, &frame, "\n", 0);
+						continue; /* no other output to stdout */
+					}
+
+					if (silent != SILENT_OFF){
+						if (silent == SILENT_ANI) {
+							printf("%c\b", anichar[silentani%=MAXANI]);
+							silentani++;
+						}
+						continue; /* no other output to stdout */
 					}
-					goto out_fflush; /* no other output to stdout */
-				}
 		      
-				printf(" %s", (color>2)?col_on[idx%MAXCOL]:"");
+					printf(" %s", (color>2)?col_on[idx%MAXCOL]:"");
 
-				switch (timestamp) {
+					switch (timestamp) {
 
-				case 'a': /* absolute with timestamp */
-					printf("(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
-					break;
+					case 'a': /* absolute with timestamp */
+						printf("(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
+						break;
 
-				case 'A': /* absolute with date */
-				{
-					struct tm tm;
-					char timestring[25];
+					case 'A': /* absolute with date */
+					{
+						struct tm tm;
+						char timestring[25];
 
-					tm = *localtime(&tv.tv_sec);
-					strftime(timestring, 24, "%Y-%m-%d %H:%M:%S", &tm);
-					printf("(%s.%06ld) ", timestring, tv.tv_usec);
-				}
-				break;
-
-				case 'd': /* delta */
-				case 'z': /* starting with zero */
-				{
-					struct timeval diff;
-
-					if (last_tv.tv_sec == 0)   /* first init */
-						last_tv = tv;
-					diff.tv_sec  = tv.tv_sec  - last_tv.tv_sec;
-					diff.tv_usec = tv.tv_usec - last_tv.tv_usec;
-					if (diff.tv_usec < 0)
-						diff.tv_sec--, diff.tv_usec += 1000000;
-					if (diff.tv_sec < 0)
-						diff.tv_sec = diff.tv_usec = 0;
-					printf("(%03ld.%06ld) ", diff.tv_sec, diff.tv_usec);
-				
-					if (timestamp == 'd')
-						last_tv = tv; /* update for delta calculation */
-				}
-				break;
+						tm = *localtime(&tv.tv_sec);
+						strftime(timestring, 24, "%Y-%m-%d %H:%M:%S", &tm);
+						printf("(%s.%06ld) ", timestring, tv.tv_usec);
+					}
+					break;
 
-				default: /* no timestamp output */
+					case 'd': /* delta */
+					case 'z': /* starting with zero */
+					{
+						struct timeval diff;
+
+						if (last_tv.tv_sec == 0)   /* first init */
+							last_tv = tv;
+						diff.tv_sec  = tv.tv_sec  - last_tv.tv_sec;
+						diff.tv_usec = tv.tv_usec - last_tv.tv_usec;
+						if (diff.tv_usec < 0)
+							diff.tv_sec--, diff.tv_usec += 1000000;
+						if (diff.tv_sec < 0)
+							diff.tv_sec = diff.tv_usec = 0;
+						printf("(%03ld.%06ld) ", diff.tv_sec, diff.tv_usec);
+				
+						if (timestamp == 'd')
+							last_tv = tv; /* update for delta calculation */
+					}
 					break;
-				}
 
-				printf(" %s", (color && (color<3))?col_on[idx%MAXCOL]:"");
-				printf("%*s", max_devname_len, devname[idx]);
-				printf("%s  ", (color==1)?col_off:"");
+					default: /* no timestamp output */
+						break;
+					}
+
+					printf(" %s", (color && (color<3))?col_on[idx%MAXCOL]:"");
+					printf("%*s", max_devname_len, devname[idx]);
+					printf("%s  ", (color==1)?col_off:"");
 
-				fprint_long_canframe(stdout, &frame, NULL, view);
+					fprint_long_canframe(stdout, &frame, NULL, view);
 
-				printf("%s", (color>1)?col_off:"");
-				printf("\n");
+					printf("%s", (color>1)?col_off:"");
+					printf("\n");
+				}
 			}
 
-		out_fflush:
 			fflush(stdout);
 		}
 	}
 
-	for (i=0; i<currmax; i++)
+	for (i=0; i<currmax; i++) {
+		if (rxring[i])
+			munmap(rxring[i], ringsize);
 		close(s[i]);
+	}
 
 	if (bridge)
 		close(bridge);
@@ -756,5 +929,7 @@ int main(int argc, char **argv)
 	if (log)
 		fclose(logfile);
 
+	free(bframes);
+
 	return 0;
 }
@@ -101,6 +101,8 @@ void print_usage(char *prg)
 		" write() syscalls)\n");
 	fprintf(stderr, "         -x            (disable local loopback of "
 		"generated CAN frames)\n");
+	fprintf(stderr, "         -m <frames>   (send <frames> CAN frames with "
+		"one write() syscall)\n");
 	fprintf(stderr, "         -v            (increment verbose level for "
 		"printing sent CAN frames)\n\n");
 	fprintf(stderr, "Generation modes:\n");
@@ -109,6 +111,8 @@ void print_usage(char *prg)
 	fprintf(stderr, "<hexvalue> => fix value using <hexvalue>\n\n");
 	fprintf(stderr, "When incrementing the CAN data the data length code "
 		"minimum is set to 1.\n");
+	fprintf(stderr, "When sending multiple frames with one write() the gap "
+		"is applied after each write().\n");
 	fprintf(stderr, "CAN IDs and data content are given and expected in hexadecimal values.\n\n");
 	fprintf(stderr, "Examples:\n");
 	fprintf(stderr, "%s vcan0 -g 4 -I 42A -L 1 -D i -v -v   ", prg);
@@ -121,6 +125,8 @@ void print_usage(char *prg)
 	fprintf(stderr, "(full load test ignoring -ENOBUFS)\n");
 	fprintf(stderr, "%s vcan0 -g 0 -p 10 -x                 ", prg);
 	fprintf(stderr, "(full load test with polling, 10ms timeout)\n");
+	fprintf(stderr, "%s vcan0 -g 0 -m 64 -p 10 -x           ", prg);
+	fprintf(stderr, "(full load test sending 64 frames per write)\n");
 	fprintf(stderr, "%s vcan0                               ", prg);
 	fprintf(stderr, "(my favourite default :)\n\n");
 }
@@ -142,6 +148,8 @@ int main(int argc, char **argv)
 	unsigned char loopback_disable = 0;
 	unsigned char verbose = 0;
 	int count = 0;
+	int batch = 0;
+	int nframes = 0;
 	uint64_t incdata = 0;
 
 	int opt;
@@ -150,6 +158,9 @@ int main(int argc, char **argv)
 
 	struct sockaddr_can addr;
 	static struct can_frame frame;
+	struct can_frame *frames = NULL;
+	char *buf;
+	int len;
 	int nbytes;
 	int i;
 	struct ifreq ifr;
@@ -165,7 +176,7 @@ int main(int argc, char **argv)
 	signal(SIGHUP, sigterm);
 	signal(SIGINT, sigterm);
 
-	while ((opt = getopt(argc, argv, "ig:eI:L:D:xp:n:vh?")) != -1) {
+	while ((opt = getopt(argc, argv, "ig:eI:L:D:xp:n:m:vh?")) != -1) {
 		switch (opt) {
 
 		case 'i':
@@ -236,6 +247,14 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'm':
+			batch = atoi(optarg);
+			if (batch < 1) {
+				print_usage(basename(argv[0]));
+				return 1;
+			}
+			break;
+
 		case '?':
 		case 'h':
 		default:
@@ -306,6 +325,22 @@ int main(int argc, char **argv)
 			   &loopback, sizeof(loopback));
 	}
 
+	if (batch) {
+		int batch_type = CAN_RAW_BATCH_FRAMES;
+
+		if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_SEND_BATCH,
+			       &batch_type, sizeof(batch_type)) < 0) {
+			perror("setsockopt CAN_RAW_SEND_BATCH");
+			return 1;
+		}
+
+		frames = malloc(batch * sizeof(struct can_frame));
+		if (!frames) {
+			perror("malloc");
+			return 1;
+		}
+	}
+
 	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
 		perror("bind");
 		return 1;
@@ -360,8 +395,23 @@ int main(int argc, char **argv)
 				fprint_canframe(stdout, &frame, "\n", 1);
 		}
 
+		buf = (char *)&frame;
+		len = sizeof(struct can_frame);
+
+		if (batch) {
+			frames[nframes++] = frame;
+
+			/* collect frames until the batch is complete */
+			if ((nframes < batch) && running)
+				goto next_frame;
+
+			buf = (char *)frames;
+			len = nframes * sizeof(struct can_frame);
+			nframes = 0;
+		}
+
 resend:
-		nbytes = write(s, &frame, sizeof(struct can_frame));
+		nbytes = write(s, buf, len);
 		if (nbytes < 0) {
 			if (errno != ENOBUFS) {
 				perror("write");
@@ -381,7 +431,14 @@ resend:
 			} else
 				enobufs_count++;
 
-		} else if (nbytes < sizeof(struct can_frame)) {
+		} else if (batch && nbytes < len &&
+			   !(nbytes % sizeof(struct can_frame))) {
+			/* not all frames of the batch have been sent */
+			buf += nbytes;
+			len -= nbytes;
+			goto resend;
+
+		} else if (nbytes < len) {
 			fprintf(stderr, "write: incomplete CAN frame\n");
 			return 1;
 		}
@@ -389,7 +446,8 @@ resend:
 		if (gap) /* gap == 0 => performance test :-] */
 			if (nanosleep(&ts, NULL))
 				return 1;
-		    
+
+next_frame:
 		if (id_mode == MODE_INCREMENT) {
 
 			frame.can_id++;
@@ -424,6 +482,7 @@ resend:
 		       enobufs_count);
 
 	close(s);
+	free(frames);
 
 	return 0;
 }
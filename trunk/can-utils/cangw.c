@@ -62,7 +62,42 @@ enum {
 	ADD,
 	DEL,
 	FLUSH,
-	LIST
+	LIST,
+	BATCH,
+	SNAPSHOT,
+	RESTORE
+};
+
+#define BATCH_MSGS 64 /* max. number of requests sent in one batch */
+
+/*
+ * Snapshot file of the job table (cangw -S / -R) in host byte order:
+ * struct cgw_snap_hdr, 'if_num' struct cgw_snap_if entries and 'len' bytes
+ * with 'msgs' RTM_NEWROUTE netlink messages (without statistics).
+ * The interface indices in the messages are mapped by the interface names
+ * on restore as they may have changed e.g. after a reboot.
+ */
+#define CGW_SNAP_MAGIC   0x53574743 /* "CGWS" */
+#define CGW_SNAP_VERSION 1
+#define SNAP_CHUNK       65536 /* max. bytes sent to the kernel at once */
+
+struct cgw_snap_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 if_num;
+	__u32 msgs;
+	__u32 len;
+};
+
+struct cgw_snap_if {
+	__u32 ifindex;
+	char name[IF_NAMESIZE];
+};
+
+struct cgw_req {
+	struct nlmsghdr nh;
+	struct rtcanmsg rtcan;
+	char buf[600];
 };
 
 struct modattr {
@@ -138,6 +173,24 @@ void print_cs_xor(struct cgw_csum_xor *cs_xor)
 	       cs_xor->result_idx, cs_xor->init_xor_val);
 }
 
+void print_cs_crc(struct cgw_csum_crc *cs_crc)
+{
+	printf("-k %d:%d:%d:%d:%X:%X:%X:%X",
+	       cs_crc->from_idx, cs_crc->to_idx, cs_crc->result_idx,
+	       cs_crc->width, cs_crc->poly, cs_crc->init_crc_val,
+	       cs_crc->final_xor_val, cs_crc->flags);
+
+	if (cs_crc->data_id_len)
+		printf(":%X:%d", cs_crc->data_id, cs_crc->data_id_len);
+
+	printf(" ");
+}
+
+void print_alive_cnt(struct cgw_alive_cnt *alive)
+{
+	printf("-a %d:%02X:%X ", alive->idx, alive->mask, alive->max_val);
+}
+
 void print_cs_crc8_profile(struct cgw_csum_crc8 *cs_crc8)
 {
 	int i;
@@ -185,23 +238,79 @@ void print_cs_crc8(struct cgw_csum_crc8 *cs_crc8)
 		print_cs_crc8_profile(cs_crc8);
 }
 
+void print_limit(struct cgw_limit *limit)
+{
+	if (limit->rate)
+		printf("-l %u:%u ", limit->rate, limit->burst);
+
+	if (limit->interval)
+		printf("-u %u ", limit->interval);
+
+	if (limit->flags & CGW_LIMIT_ON_CHANGE)
+		printf("-U ");
+}
+
+/* frame counters are __u64 in the CGW_xxx64 attributes, otherwise __u32 */
+__u64 get_counter(struct rtattr *rta)
+{
+	if (RTA_PAYLOAD(rta) == sizeof(__u64))
+		return *(__u64 *)RTA_DATA(rta);
+	else
+		return *(__u32 *)RTA_DATA(rta);
+}
+
+void print_lat_hist(struct rtattr *rta)
+{
+	__u64 hist[CGW_LAT_BUCKETS];
+	int i;
+
+	if (RTA_PAYLOAD(rta) != sizeof(hist))
+		return;
+
+	memcpy(hist, RTA_DATA(rta), sizeof(hist));
+
+	printf(" latency[us]");
+
+	for (i = 0; i < CGW_LAT_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+
+		if (i == CGW_LAT_BUCKETS - 1)
+			printf(" >=%u:%llu", 1U << (i - 1), hist[i]);
+		else
+			printf(" <%u:%llu", 1U << i, hist[i]);
+	}
+}
+
 void print_usage(char *prg)
 {
 	fprintf(stderr, "\nUsage: %s [options]\n\n", prg);
 	fprintf(stderr, "Commands:  -A (add a new rule)\n");
 	fprintf(stderr, "           -D (delete a rule)\n");
-	fprintf(stderr, "           -F (flush / delete all rules)\n");
+	fprintf(stderr, "           -F (flush / delete all CAN->CAN rules)\n");
 	fprintf(stderr, "           -L (list all rules)\n");
+	fprintf(stderr, "           -B <file> (process -A/-D/-F rules from file or '-' for stdin)\n");
+	fprintf(stderr, "           -S <file> (save all rules into a binary snapshot file)\n");
+	fprintf(stderr, "           -R <file> (flush and restore the CAN->CAN rules from a snapshot file)\n");
 	fprintf(stderr, "Mandatory: -s <src_dev>  (source netdevice)\n");
-	fprintf(stderr, "           -d <dst_dev>  (destination netdevice)\n");
+	fprintf(stderr, "           -d <dst_dev>  (destination netdevice - up to %d times)\n", CGW_DST_MAX);
 	fprintf(stderr, "Options:   -t (preserve src_dev rx timestamp)\n");
 	fprintf(stderr, "           -e (echo sent frames - recommended on vcanx)\n");
+	fprintf(stderr, "           -H (collect a histogram of the forwarding latency)\n");
 	fprintf(stderr, "           -f <filter> (set CAN filter)\n");
 	fprintf(stderr, "           -m <mod> (set frame modifications)\n");
 	fprintf(stderr, "           -x <from_idx>:<to_idx>:<result_idx>:<init_xor_val> (XOR checksum)\n");
 	fprintf(stderr, "           -c <from>:<to>:<result>:<init_val>:<xor_val>:<crctab[256]> (CRC8 cs)\n");
 	fprintf(stderr, "           -p <profile>:[<profile_data>] (CRC8 checksum profile & parameters)\n");
+	fprintf(stderr, "           -k <from>:<to>:<result>:<width>:<poly>:<init>:<xor>:<flags>[:<data_id>:<data_id_len>]\n");
+	fprintf(stderr, "              (CRC16/CRC32 checksum - <width> and <data_id_len> in decimal)\n");
+	fprintf(stderr, "           -a <idx>:<mask>:<max_val> (alive counter in data[idx] bits of mask)\n");
+	fprintf(stderr, "           -l <rate>:<burst> (limit to <rate> frames/s with max. <burst> frames)\n");
+	fprintf(stderr, "           -u <interval> (forward a CAN ID at most every <interval> ms)\n");
+	fprintf(stderr, "           -U (forward CAN frames with changed content - with -u or only these)\n");
+	fprintf(stderr, "           -T <hops> (limit the routing hops of frames received by this rule)\n");
 	fprintf(stderr, "\nValues are given and expected in hexadecimal values. Leading 0s can be omitted.\n");
+	fprintf(stderr, "Only the rate limit values for -l and -u and the hops for -T are given in decimal values.\n");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "<filter> is a <value><mask> CAN identifier filter\n");
 	fprintf(stderr, "   <can_id>:<can_mask> (matches when <received_can_id> & mask == can_id & mask)\n");
@@ -218,12 +327,21 @@ void print_usage(char *prg)
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Example:\n");
 	fprintf(stderr, "%s -A -s can0 -d vcan3 -e -f 123:C00007FF -m SET:IL:333.4.1122334455667788\n", prg);
+	fprintf(stderr, "%s -A -s can0 -d vcan1 -d vcan2 -d vcan3 -e (mirror can0 to three interfaces)\n", prg);
+	fprintf(stderr, "%s -A -s can0 -d can1 -l 500:20 -u 1000 -U (changes & one frame/s per CAN ID)\n", prg);
+	fprintf(stderr, "%s -A -s can0 -d can1 -T 1 (no further routing of these frames - see max_hops)\n", prg);
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Supported CRC 8 profiles:\n");
 	fprintf(stderr, "Profile '%d' (1U8)       - add one additional u8 value\n", CGW_CRC8PRF_1U8);
 	fprintf(stderr, "Profile '%d' (16U8)      - add u8 value from table[16] indexed by (data[1] & 0xF)\n", CGW_CRC8PRF_16U8);
 	fprintf(stderr, "Profile '%d' (SFFID_XOR) - add u8 value (can_id & 0xFF) ^ (can_id >> 8 & 0xFF)\n", CGW_CRC8PRF_SFFID_XOR);
 	fprintf(stderr, "\n");
+	fprintf(stderr, "CRC16/CRC32 <flags>: %d = reflected algorithm, %d = store result big endian\n",
+		CGW_CRC_REFLECTED, CGW_CRC_RESULT_BE);
+	fprintf(stderr, "E.g. alive counter 0..E in data[2] & 0xF and CRC-16/CCITT-FALSE over data[2..7]\n");
+	fprintf(stderr, "and the data id 0x1234 into data[0..1]:\n");
+	fprintf(stderr, "%s -A -s can0 -d can1 -a 2:0F:E -k 2:7:0:16:1021:FFFF:0:0:1234:2\n", prg);
+	fprintf(stderr, "\n");
 }
 
 int b64hex(char *asc, unsigned char *bin, int len)
@@ -356,9 +474,13 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 	struct rtattr *rta;
 	struct nlmsghdr *nlh;
 	unsigned int src_ifindex = 0;
-	unsigned int dst_ifindex = 0;
-	__u32 handled, dropped;
+	unsigned int dst_ifindex[CGW_DST_MAX];
+	int dst_num;
+	__u32 ring_id;
+	__u64 handled, dropped, suppressed, deleted;
+	struct rtattr *lat_hist;
 	int rtlen;
+	int i;
 
 
 	nlh = (struct nlmsghdr *)rxbuf;
@@ -383,7 +505,8 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 			return -EINVAL;
 		}
 
-		if (rtc->gwtype != CGW_TYPE_CAN_CAN) {
+		if (rtc->gwtype != CGW_TYPE_CAN_CAN &&
+		    rtc->gwtype != CGW_TYPE_CAN_RING) {
 			printf("received msg with unknown gwtype %d\n", rtc->gwtype);
 			return -EINVAL;
 		}
@@ -398,8 +521,16 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 
 		handled = 0;
 		dropped = 0;
+		suppressed = 0;
+		deleted = 0;
+		lat_hist = NULL;
 		src_ifindex = 0;
-		dst_ifindex = 0;
+		dst_num = 0;
+		ring_id = 0;
+
+		/* userspace ring jobs are created by the ring owner only */
+		if (rtc->gwtype == CGW_TYPE_CAN_RING)
+			printf("# ");
 
 		printf("%s -A ", basename(prgname));
 
@@ -418,6 +549,10 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 			case CGW_MOD_SET:
 			case CGW_CS_XOR:
 			case CGW_CS_CRC8:
+			case CGW_CS_CRC:
+			case CGW_ALIVE_CNT:
+			case CGW_LIMIT:
+			case CGW_LIM_HOPS:
 				break;
 
 			case CGW_SRC_IF:
@@ -425,15 +560,55 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 				break;
 
 			case CGW_DST_IF:
-				dst_ifindex = *(__u32 *)RTA_DATA(rta);
+				dst_ifindex[0] = *(__u32 *)RTA_DATA(rta);
+				dst_num = 1;
 				break;
 
+			case CGW_DST_IFS:
+				dst_num = RTA_PAYLOAD(rta) / sizeof(__u32);
+				if (dst_num > CGW_DST_MAX)
+					dst_num = CGW_DST_MAX;
+				memcpy(dst_ifindex, RTA_DATA(rta), dst_num * sizeof(__u32));
+				break;
+
+			case CGW_RING_ID:
+				ring_id = *(__u32 *)RTA_DATA(rta);
+				break;
+
+			/* prefer the 64 bit counters of newer kernels */
 			case CGW_HANDLED:
-				handled = *(__u32 *)RTA_DATA(rta);
+				if (!handled)
+					handled = get_counter(rta);
 				break;
 
 			case CGW_DROPPED:
-				dropped = *(__u32 *)RTA_DATA(rta);
+				if (!dropped)
+					dropped = get_counter(rta);
+				break;
+
+			case CGW_SUPPRESSED:
+				if (!suppressed)
+					suppressed = get_counter(rta);
+				break;
+
+			case CGW_HANDLED64:
+				handled = get_counter(rta);
+				break;
+
+			case CGW_DROPPED64:
+				dropped = get_counter(rta);
+				break;
+
+			case CGW_SUPPRESSED64:
+				suppressed = get_counter(rta);
+				break;
+
+			case CGW_DELETED:
+				deleted = get_counter(rta);
+				break;
+
+			case CGW_LAT_HIST:
+				lat_hist = rta;
 				break;
 
 			default:
@@ -445,7 +620,11 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 
 
 		printf("-s %s ", if_indextoname(src_ifindex, ifname));
-		printf("-d %s ", if_indextoname(dst_ifindex, ifname));
+		for (i = 0; i < dst_num; i++)
+			printf("-d %s ", if_indextoname(dst_ifindex[i], ifname));
+
+		if (ring_id)
+			printf("(ring %u) ", ring_id);
 
 		if (rtc->flags & CGW_FLAGS_CAN_ECHO)
 			printf("-e ");
@@ -453,6 +632,9 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 		if (rtc->flags & CGW_FLAGS_CAN_SRC_TSTAMP)
 			printf("-t ");
 
+		if (rtc->flags & CGW_FLAGS_CAN_LAT_HIST)
+			printf("-H ");
+
 		/* second parse for mod attributes */
 		rta = (struct rtattr *) RTCAN_RTA(rtc);
 		rtlen = RTCAN_PAYLOAD(nlh);
@@ -489,10 +671,34 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 				print_cs_crc8((struct cgw_csum_crc8 *)RTA_DATA(rta));
 				break;
 
+			case CGW_CS_CRC:
+				print_cs_crc((struct cgw_csum_crc *)RTA_DATA(rta));
+				break;
+
+			case CGW_ALIVE_CNT:
+				print_alive_cnt((struct cgw_alive_cnt *)RTA_DATA(rta));
+				break;
+
+			case CGW_LIMIT:
+				print_limit((struct cgw_limit *)RTA_DATA(rta));
+				break;
+
+			case CGW_LIM_HOPS:
+				printf("-T %d ", *(__u8 *)RTA_DATA(rta));
+				break;
+
 			case CGW_SRC_IF:
 			case CGW_DST_IF:
+			case CGW_DST_IFS:
+			case CGW_RING_ID:
 			case CGW_HANDLED:
 			case CGW_DROPPED:
+			case CGW_SUPPRESSED:
+			case CGW_HANDLED64:
+			case CGW_DROPPED64:
+			case CGW_SUPPRESSED64:
+			case CGW_DELETED:
+			case CGW_LAT_HIST:
 				break;
 
 			default:
@@ -502,16 +708,31 @@ int parse_rtlist(char *prgname, unsigned char *rxbuf, int len)
 			}
 		}
 
-		printf("# %d handled %d dropped\n", handled, dropped); /* end of entry */
+		printf("# %llu handled %llu dropped", handled, dropped);
+
+		if (suppressed)
+			printf(" %llu suppressed", suppressed);
+
+		if (deleted)
+			printf(" %llu deleted", deleted);
+
+		if (lat_hist)
+			print_lat_hist(lat_hist);
+
+		printf("\n"); /* end of entry */
 
 		/* jump to next NLMSG in the given buffer */
 		nlh = NLMSG_NEXT(nlh, len);
 	}
 }
 
-int main(int argc, char **argv)
+/*
+ * Build the netlink request for the given command line options in 'req'.
+ * 'batchfile' returns the file of -B/-S/-R and is NULL when parsing the
+ * lines of a batch file.
+ */
+int parse_request(int argc, char **argv, struct cgw_req *r, char **batchfile)
 {
-	int s;
 	int err = 0;
 
 	int opt;
@@ -521,27 +742,28 @@ int main(int argc, char **argv)
 	int have_filter = 0;
 	int have_cs_xor = 0;
 	int have_cs_crc8 = 0;
+	int have_limit = 0;
+	int have_lim_hops = 0;
+	int have_cs_crc = 0;
+	int have_alive = 0;
+	int cnt;
 
-	struct {
-		struct nlmsghdr nh;
-		struct rtcanmsg rtcan;
-		char buf[600];
-
-	} req;
+	struct cgw_req req;
 
-	unsigned char rxbuf[8192]; /* netlink receive buffer */
-	struct nlmsghdr *nlh;
-	struct nlmsgerr *rte;
 	unsigned int src_ifindex = 0;
-	unsigned int dst_ifindex = 0;
+	unsigned int dst_ifindex[CGW_DST_MAX] = {0};
+	int dst_num = 0;
 	__u16 flags = 0;
-	int len;
 
 	struct can_filter filter;
-	struct sockaddr_nl nladdr;
 
 	struct cgw_csum_xor cs_xor;
 	struct cgw_csum_crc8 cs_crc8;
+	struct cgw_limit limit;
+	struct cgw_csum_crc cs_crc;
+	unsigned int crc_val[4] = {0}; /* poly, init, xor, data_id */
+	struct cgw_alive_cnt alive;
+	__u8 lim_hops = 0;
 	char crc8tab[513] = {0};
 
 	struct modattr modmsg[CGW_MOD_FUNCS];
@@ -551,8 +773,14 @@ int main(int argc, char **argv)
 	memset(&req, 0, sizeof(req));
 	memset(&cs_xor, 0, sizeof(cs_xor));
 	memset(&cs_crc8, 0, sizeof(cs_crc8));
+	memset(&limit, 0, sizeof(limit));
+	memset(&cs_crc, 0, sizeof(cs_crc));
+	memset(&alive, 0, sizeof(alive));
 
-	while ((opt = getopt(argc, argv, "ADFLs:d:tef:c:p:x:m:?")) != -1) {
+	/* restart the option parsing for each line of a batch file */
+	optind = 1;
+
+	while ((opt = getopt(argc, argv, "ADFLB:S:R:s:d:teHf:c:p:x:k:a:m:l:u:UT:?")) != -1) {
 		switch (opt) {
 
 		case 'A':
@@ -575,12 +803,39 @@ int main(int argc, char **argv)
 				cmd = LIST;
 			break;
 
+		case 'B':
+			if (!batchfile) {
+				printf("Nested batch files are not supported.\n");
+				exit(1);
+			}
+			if (cmd == UNSPEC) {
+				cmd = BATCH;
+				*batchfile = optarg;
+			}
+			break;
+
+		case 'S':
+		case 'R':
+			if (!batchfile) {
+				printf("Snapshots are not supported in batch files.\n");
+				exit(1);
+			}
+			if (cmd == UNSPEC) {
+				cmd = (opt == 'S') ? SNAPSHOT : RESTORE;
+				*batchfile = optarg;
+			}
+			break;
+
 		case 's':
 			src_ifindex = if_nametoindex(optarg);
 			break;
 
 		case 'd':
-			dst_ifindex = if_nametoindex(optarg);
+			if (dst_num == CGW_DST_MAX) {
+				printf("Too many destination interfaces (max. %d).\n", CGW_DST_MAX);
+				exit(1);
+			}
+			dst_ifindex[dst_num++] = if_nametoindex(optarg);
 			break;
 
 		case 't':
@@ -591,6 +846,10 @@ int main(int argc, char **argv)
 			flags |= CGW_FLAGS_CAN_ECHO;
 			break;
 
+		case 'H':
+			flags |= CGW_FLAGS_CAN_LAT_HIST;
+			break;
+
 		case 'f':
 			if (sscanf(optarg, "%x:%x", &filter.can_id,
 				   &filter.can_mask) == 2) {
@@ -630,6 +889,36 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'k':
+			cnt = sscanf(optarg, "%hhd:%hhd:%hhd:%hhu:%x:%x:%x:%hhx:%x:%hhu",
+				     &cs_crc.from_idx, &cs_crc.to_idx,
+				     &cs_crc.result_idx, &cs_crc.width,
+				     &crc_val[0], &crc_val[1], &crc_val[2],
+				     &cs_crc.flags, &crc_val[3],
+				     &cs_crc.data_id_len);
+			if ((cnt == 8 || cnt == 10) &&
+			    (cs_crc.width == 16 || cs_crc.width == 32)) {
+				cs_crc.poly = crc_val[0];
+				cs_crc.init_crc_val = crc_val[1];
+				cs_crc.final_xor_val = crc_val[2];
+				cs_crc.data_id = crc_val[3];
+				have_cs_crc = 1;
+			} else {
+				printf("Bad CRC checksum definition '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+
+		case 'a':
+			if (sscanf(optarg, "%hhd:%hhx:%hhx", &alive.idx,
+				   &alive.mask, &alive.max_val) == 3 && alive.mask) {
+				have_alive = 1;
+			} else {
+				printf("Bad alive counter definition '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+
 		case 'p':
 			if (parse_crc8_profile(optarg, &cs_crc8)) {
 				printf("Bad CRC8 profile definition '%s'.\n", optarg);
@@ -645,6 +934,40 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'l':
+			if (sscanf(optarg, "%u:%u", &limit.rate, &limit.burst) == 2 &&
+			    limit.rate && limit.burst) {
+				have_limit = 1;
+			} else {
+				printf("Bad rate limit definition '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+
+		case 'u':
+			if (sscanf(optarg, "%u", &limit.interval) == 1) {
+				have_limit = 1;
+			} else {
+				printf("Bad interval definition '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+
+		case 'U':
+			limit.flags |= CGW_LIMIT_ON_CHANGE;
+			have_limit = 1;
+			break;
+
+		case 'T':
+			if (sscanf(optarg, "%hhu", &lim_hops) == 1 &&
+			    lim_hops >= CGW_MIN_HOPS && lim_hops <= CGW_MAX_HOPS) {
+				have_lim_hops = 1;
+			} else {
+				printf("Bad hop limit definition '%s'.\n", optarg);
+				exit(1);
+			}
+			break;
+
 		case '?':
 			print_usage(basename(argv[0]));
 			exit(0);
@@ -663,14 +986,15 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	if (cmd == BATCH || cmd == SNAPSHOT || cmd == RESTORE)
+		return cmd;
+
 	if ((cmd == ADD || cmd == DEL) &&
-	    ((!src_ifindex) || (!dst_ifindex))) {
+	    ((!src_ifindex) || (!dst_ifindex[0]))) {
 		print_usage(basename(argv[0]));
 		exit(1);
 	}
 
-	s = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-
 	switch (cmd) {
 
 	case ADD:
@@ -688,7 +1012,8 @@ int main(int argc, char **argv)
 		req.nh.nlmsg_type  = RTM_DELROUTE;
 		/* if_index set to 0 => remove all entries */
 		src_ifindex  = 0;
-		dst_ifindex  = 0;
+		dst_ifindex[0] = 0;
+		dst_num = 1;
 		break;
 
 	case LIST:
@@ -710,7 +1035,12 @@ int main(int argc, char **argv)
 	req.rtcan.flags = flags;
 
 	addattr_l(&req.nh, sizeof(req), CGW_SRC_IF, &src_ifindex, sizeof(src_ifindex));
-	addattr_l(&req.nh, sizeof(req), CGW_DST_IF, &dst_ifindex, sizeof(dst_ifindex));
+
+	/* one destination interface or a set of destination interfaces */
+	if (dst_num > 1)
+		addattr_l(&req.nh, sizeof(req), CGW_DST_IFS, dst_ifindex, dst_num * sizeof(dst_ifindex[0]));
+	else
+		addattr_l(&req.nh, sizeof(req), CGW_DST_IF, &dst_ifindex[0], sizeof(dst_ifindex[0]));
 
 	/* add new attributes here */
 
@@ -723,6 +1053,18 @@ int main(int argc, char **argv)
 	if (have_cs_xor)
 		addattr_l(&req.nh, sizeof(req), CGW_CS_XOR, &cs_xor, sizeof(cs_xor));
 
+	if (have_cs_crc)
+		addattr_l(&req.nh, sizeof(req), CGW_CS_CRC, &cs_crc, CGW_CS_CRC_LEN);
+
+	if (have_alive)
+		addattr_l(&req.nh, sizeof(req), CGW_ALIVE_CNT, &alive, CGW_ALIVE_CNT_LEN);
+
+	if (have_limit)
+		addattr_l(&req.nh, sizeof(req), CGW_LIMIT, &limit, CGW_LIMIT_LEN);
+
+	if (have_lim_hops)
+		addattr_l(&req.nh, sizeof(req), CGW_LIM_HOPS, &lim_hops, sizeof(lim_hops));
+
 	/*
 	 * a better example code
 	 * modmsg.modtype = CGW_MOD_ID;
@@ -733,6 +1075,515 @@ int main(int argc, char **argv)
 	for (i = 0; i < modidx; i++)
 		addattr_l(&req.nh, sizeof(req), modmsg[i].instruction, &modmsg[i], CGW_MODATTR_LEN);
 
+	memcpy(r, &req, sizeof(req));
+
+	return cmd;
+}
+
+/*
+ * Send the collected requests of a batch in one netlink message and check
+ * the acknowledges. The nlmsg_seq of each request is the index in 'lines'
+ * which contains the line (or job) numbers for the error messages.
+ */
+int send_batch(int s, unsigned char *buf, int len, int msgs, int *lines,
+	       const char *what)
+{
+	unsigned char rxbuf[8192]; /* netlink receive buffer */
+	struct sockaddr_nl nladdr;
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *rte;
+	int acks = 0;
+	int errors = 0;
+	int rxlen;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+
+	if (sendto(s, buf, len, 0, (struct sockaddr*)&nladdr, sizeof(nladdr)) < 0) {
+		perror("netlink sendto");
+		return msgs;
+	}
+
+	while (acks < msgs) {
+		rxlen = recv(s, &rxbuf, sizeof(rxbuf), 0);
+		if (rxlen < 0) {
+			perror("netlink recv");
+			return msgs - acks + errors;
+		}
+
+		for (nlh = (struct nlmsghdr *)rxbuf; NLMSG_OK(nlh, rxlen);
+		     nlh = NLMSG_NEXT(nlh, rxlen)) {
+
+			if (nlh->nlmsg_type != NLMSG_ERROR)
+				continue;
+
+			acks++;
+			rte = (struct nlmsgerr *)NLMSG_DATA(nlh);
+			if (rte->error < 0 && nlh->nlmsg_seq < msgs) {
+				fprintf(stderr, "%s %d: netlink error %d (%s)\n",
+					what, lines[nlh->nlmsg_seq], rte->error,
+					strerror(abs(rte->error)));
+				errors++;
+			}
+		}
+	}
+
+	return errors;
+}
+
+/*
+ * Process a file with one cangw command line per line, e.g. the output of
+ * 'cangw -L'. Comments starting with '#' and a leading program name are
+ * skipped. Up to BATCH_MSGS requests are sent to the kernel at once.
+ */
+int run_batch(int s, char *prg, char *batchfile)
+{
+	static unsigned char buf[BATCH_MSGS * sizeof(struct cgw_req)];
+	int lines[BATCH_MSGS];
+	char line[2048];
+	char *args[128];
+	struct cgw_req req;
+	FILE *infile;
+	char *ptr;
+	int lineno = 0;
+	int msgs = 0;
+	int errors = 0;
+	int len = 0;
+	int cnt, cmd;
+
+	if (!strcmp(batchfile, "-"))
+		infile = stdin;
+	else
+		infile = fopen(batchfile, "r");
+
+	if (!infile) {
+		perror(batchfile);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), infile)) {
+
+		lineno++;
+
+		ptr = strchr(line, '#');
+		if (ptr)
+			*ptr = 0;
+
+		cnt = 0;
+		args[cnt++] = prg;
+
+		for (ptr = strtok(line, " \t\r\n"); ptr && cnt < 127;
+		     ptr = strtok(NULL, " \t\r\n")) {
+			/* skip program name e.g. from the 'cangw -L' output */
+			if (cnt == 1 && ptr[0] != '-')
+				continue;
+			args[cnt++] = ptr;
+		}
+		args[cnt] = NULL;
+
+		/* empty line */
+		if (cnt == 1)
+			continue;
+
+		cmd = parse_request(cnt, args, &req, NULL);
+		if (cmd != ADD && cmd != DEL && cmd != FLUSH) {
+			fprintf(stderr, "line %d: only -A -D -F are supported in batch mode.\n",
+				lineno);
+			errors++;
+			continue;
+		}
+
+		req.nh.nlmsg_seq = msgs;
+		lines[msgs++] = lineno;
+		memcpy(buf + len, &req, req.nh.nlmsg_len);
+		len += NLMSG_ALIGN(req.nh.nlmsg_len);
+
+		if (msgs == BATCH_MSGS) {
+			errors += send_batch(s, buf, len, msgs, lines, "line");
+			msgs = 0;
+			len = 0;
+		}
+	}
+
+	if (msgs)
+		errors += send_batch(s, buf, len, msgs, lines, "line");
+
+	if (infile != stdin)
+		fclose(infile);
+
+	return errors ? 1 : 0;
+}
+
+/* remember the name of an interface index used in the snapshot */
+int add_snap_if(struct cgw_snap_if *ifs, int if_num, __u32 ifindex)
+{
+	int i;
+
+	for (i = 0; i < if_num; i++)
+		if (ifs[i].ifindex == ifindex)
+			return if_num;
+
+	ifs[if_num].ifindex = ifindex;
+	if (!if_indextoname(ifindex, ifs[if_num].name)) {
+		fprintf(stderr, "unknown interface index %u\n", ifindex);
+		exit(1);
+	}
+
+	return if_num + 1;
+}
+
+/*
+ * Dump the job table and write the CAN->CAN jobs as RTM_NEWROUTE requests
+ * into a snapshot file. The statistics are not saved and ring jobs are
+ * skipped as the rings belong to running processes.
+ */
+int save_snapshot(int s, char *snapfile)
+{
+	struct cgw_snap_hdr hdr;
+	struct cgw_snap_if *ifs = NULL;
+	int if_max = 0;
+	unsigned char rxbuf[8192]; /* netlink receive buffer */
+	unsigned char *buf = NULL;
+	int buf_max = 0;
+	struct cgw_req req;
+	struct sockaddr_nl nladdr;
+	struct nlmsghdr *nlh, *tx;
+	struct rtcanmsg *rtc;
+	struct rtattr *rta;
+	__u32 *idx;
+	int rtlen, len, i;
+	int skipped = 0;
+	int done = 0;
+	FILE *outfile;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CGW_SNAP_MAGIC;
+	hdr.version = CGW_SNAP_VERSION;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_type  = RTM_GETROUTE;
+	req.rtcan.can_family = AF_CAN;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+
+	if (sendto(s, &req, req.nh.nlmsg_len, 0,
+		   (struct sockaddr*)&nladdr, sizeof(nladdr)) < 0) {
+		perror("netlink sendto");
+		return 1;
+	}
+
+	while (!done) {
+		len = recv(s, &rxbuf, sizeof(rxbuf), 0);
+		if (len < 0) {
+			perror("netlink recv");
+			return 1;
+		}
+
+		for (nlh = (struct nlmsghdr *)rxbuf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+
+			if (nlh->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				fprintf(stderr, "netlink error while dumping the rules\n");
+				return 1;
+			}
+
+			rtc = (struct rtcanmsg *)NLMSG_DATA(nlh);
+			if (rtc->can_family != AF_CAN) {
+				fprintf(stderr, "received msg from unknown family %d\n",
+					rtc->can_family);
+				return 1;
+			}
+
+			if (rtc->gwtype != CGW_TYPE_CAN_CAN) {
+				skipped++;
+				continue;
+			}
+
+			/* make room for the request and its interfaces */
+			if (hdr.len + nlh->nlmsg_len > buf_max) {
+				buf_max = 2 * buf_max + nlh->nlmsg_len;
+				buf = realloc(buf, buf_max);
+			}
+			if (hdr.if_num + CGW_DST_MAX + 1 > if_max) {
+				if_max = 2 * if_max + CGW_DST_MAX + 1;
+				ifs = realloc(ifs, if_max * sizeof(*ifs));
+			}
+			if (!buf || !ifs) {
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+
+			tx = (struct nlmsghdr *)(buf + hdr.len);
+			tx->nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+			tx->nlmsg_type  = RTM_NEWROUTE;
+			tx->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+			tx->nlmsg_seq   = 0;
+			tx->nlmsg_pid   = 0;
+			memcpy(NLMSG_DATA(tx), rtc, sizeof(*rtc));
+
+			/* copy the job attributes without the statistics */
+			rta = (struct rtattr *) RTCAN_RTA(rtc);
+			rtlen = RTCAN_PAYLOAD(nlh);
+			for(;RTA_OK(rta, rtlen);rta=RTA_NEXT(rta,rtlen)) {
+
+				switch(rta->rta_type) {
+
+				case CGW_HANDLED:
+				case CGW_DROPPED:
+				case CGW_SUPPRESSED:
+				case CGW_HANDLED64:
+				case CGW_DROPPED64:
+				case CGW_SUPPRESSED64:
+				case CGW_DELETED:
+				case CGW_LAT_HIST:
+					continue;
+
+				case CGW_SRC_IF:
+				case CGW_DST_IF:
+				case CGW_DST_IFS:
+					idx = (__u32 *)RTA_DATA(rta);
+					for (i = 0; i < RTA_PAYLOAD(rta) / sizeof(__u32); i++)
+						hdr.if_num = add_snap_if(ifs, hdr.if_num, idx[i]);
+					break;
+				}
+
+				memcpy(NLMSG_TAIL(tx), rta, rta->rta_len);
+				tx->nlmsg_len = NLMSG_ALIGN(tx->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+			}
+
+			hdr.len += NLMSG_ALIGN(tx->nlmsg_len);
+			hdr.msgs++;
+		}
+	}
+
+	if (!strcmp(snapfile, "-"))
+		outfile = stdout;
+	else
+		outfile = fopen(snapfile, "w");
+
+	if (!outfile) {
+		perror(snapfile);
+		return 1;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, outfile) != 1 ||
+	    (hdr.if_num && fwrite(ifs, sizeof(*ifs), hdr.if_num, outfile) != hdr.if_num) ||
+	    (hdr.len && fwrite(buf, hdr.len, 1, outfile) != 1)) {
+		perror(snapfile);
+		return 1;
+	}
+
+	if (outfile != stdout)
+		fclose(outfile);
+
+	if (skipped)
+		fprintf(stderr, "%d ring rules have not been saved.\n", skipped);
+
+	free(buf);
+	free(ifs);
+
+	return 0;
+}
+
+/*
+ * Flush the CAN->CAN jobs and add the jobs of a snapshot file. The ring jobs
+ * of running processes are not touched. The requests are sent in netlink
+ * messages of up to SNAP_CHUNK bytes and BATCH_MSGS requests to keep the
+ * acknowledges within the netlink receive buffer.
+ */
+int restore_snapshot(int s, char *snapfile)
+{
+	struct cgw_snap_hdr hdr;
+	struct cgw_snap_if *ifs = NULL;
+	unsigned char *buf = NULL;
+	unsigned int *newidx = NULL;
+	int *jobs = NULL;
+	struct cgw_req req;
+	struct nlmsghdr *nlh;
+	struct rtattr *rta;
+	__u32 *idx;
+	__u32 zero = 0;
+	int rtlen, len, off, start, msgs, job, i, j;
+	int errors = 0;
+	FILE *infile;
+
+	if (!strcmp(snapfile, "-"))
+		infile = stdin;
+	else
+		infile = fopen(snapfile, "r");
+
+	if (!infile) {
+		perror(snapfile);
+		return 1;
+	}
+
+	if (fread(&hdr, sizeof(hdr), 1, infile) != 1 ||
+	    hdr.magic != CGW_SNAP_MAGIC || hdr.version != CGW_SNAP_VERSION) {
+		fprintf(stderr, "%s: no valid snapshot file\n", snapfile);
+		return 1;
+	}
+
+	ifs = malloc(hdr.if_num * sizeof(*ifs) + 1);
+	newidx = malloc(hdr.if_num * sizeof(*newidx) + 1);
+	buf = malloc(hdr.len + 1);
+	jobs = malloc(hdr.msgs * sizeof(*jobs) + 1);
+	if (!ifs || !newidx || !buf || !jobs) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	if ((hdr.if_num && fread(ifs, sizeof(*ifs), hdr.if_num, infile) != hdr.if_num) ||
+	    (hdr.len && fread(buf, hdr.len, 1, infile) != 1)) {
+		fprintf(stderr, "%s: truncated snapshot file\n", snapfile);
+		return 1;
+	}
+
+	if (infile != stdin)
+		fclose(infile);
+
+	/* all interfaces have to be present before the rules are flushed */
+	for (i = 0; i < hdr.if_num; i++) {
+		ifs[i].name[IF_NAMESIZE - 1] = 0;
+		newidx[i] = if_nametoindex(ifs[i].name);
+		if (!newidx[i]) {
+			fprintf(stderr, "interface %s not found\n", ifs[i].name);
+			return 1;
+		}
+	}
+
+	/* check the messages and map the interface indices */
+	len = hdr.len;
+	msgs = 0;
+	for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+	     nlh = NLMSG_NEXT(nlh, len)) {
+
+		if (nlh->nlmsg_type != RTM_NEWROUTE ||
+		    nlh->nlmsg_len < NLMSG_LENGTH(sizeof(struct rtcanmsg)) ||
+		    nlh->nlmsg_len > SNAP_CHUNK)
+			break;
+
+		rta = (struct rtattr *) RTCAN_RTA(NLMSG_DATA(nlh));
+		rtlen = RTCAN_PAYLOAD(nlh);
+		for(;RTA_OK(rta, rtlen);rta=RTA_NEXT(rta,rtlen)) {
+
+			if (rta->rta_type != CGW_SRC_IF &&
+			    rta->rta_type != CGW_DST_IF &&
+			    rta->rta_type != CGW_DST_IFS)
+				continue;
+
+			idx = (__u32 *)RTA_DATA(rta);
+			for (i = 0; i < RTA_PAYLOAD(rta) / sizeof(__u32); i++) {
+				for (j = 0; j < hdr.if_num; j++) {
+					if (ifs[j].ifindex == idx[i]) {
+						idx[i] = newidx[j];
+						break;
+					}
+				}
+			}
+		}
+		msgs++;
+	}
+
+	if (len || msgs != hdr.msgs) {
+		fprintf(stderr, "%s: corrupted snapshot file\n", snapfile);
+		return 1;
+	}
+
+	/* flush all CAN->CAN rules first - like 'cangw -F' */
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req.nh.nlmsg_type  = RTM_DELROUTE;
+	req.rtcan.can_family = AF_CAN;
+	req.rtcan.gwtype = CGW_TYPE_CAN_CAN;
+	addattr_l(&req.nh, sizeof(req), CGW_SRC_IF, &zero, sizeof(zero));
+	addattr_l(&req.nh, sizeof(req), CGW_DST_IF, &zero, sizeof(zero));
+
+	jobs[0] = 0;
+	if (send_batch(s, (unsigned char *)&req, req.nh.nlmsg_len, 1, jobs,
+		       "flush"))
+		return 1;
+
+	/* send the requests in chunks of complete netlink messages */
+	job = 0;
+	off = 0;
+	start = 0;
+	msgs = 0;
+	len = hdr.len;
+	for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+	     nlh = NLMSG_NEXT(nlh, len)) {
+
+		job++;
+
+		/* the next request does not fit into the current chunk */
+		if (msgs == BATCH_MSGS ||
+		    off + NLMSG_ALIGN(nlh->nlmsg_len) - start > SNAP_CHUNK) {
+			errors += send_batch(s, buf + start, off - start, msgs,
+					     jobs, "rule");
+			start = off;
+			msgs = 0;
+		}
+
+		nlh->nlmsg_seq = msgs;
+		jobs[msgs++] = job;
+		off += NLMSG_ALIGN(nlh->nlmsg_len);
+	}
+
+	if (msgs)
+		errors += send_batch(s, buf + start, off - start, msgs, jobs,
+				     "rule");
+
+	free(ifs);
+	free(newidx);
+	free(buf);
+	free(jobs);
+
+	return errors ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int s;
+	int err = 0;
+	int cmd;
+	char *batchfile = NULL;
+
+	struct cgw_req req;
+
+	unsigned char rxbuf[8192]; /* netlink receive buffer */
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *rte;
+	int len;
+
+	struct sockaddr_nl nladdr;
+
+	cmd = parse_request(argc, argv, &req, &batchfile);
+
+	s = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+
+	if (cmd == BATCH) {
+		err = run_batch(s, argv[0], batchfile);
+		close(s);
+		return err;
+	}
+
+	if (cmd == SNAPSHOT || cmd == RESTORE) {
+		if (cmd == SNAPSHOT)
+			err = save_snapshot(s, batchfile);
+		else
+			err = restore_snapshot(s, batchfile);
+		close(s);
+		return err;
+	}
+
 	memset(&nladdr, 0, sizeof(nladdr));
 	nladdr.nl_family = AF_NETLINK;
 	nladdr.nl_pid    = 0;
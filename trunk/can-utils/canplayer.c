@@ -91,6 +91,8 @@ void print_usage(char *prg)
 		"timestamps > 's' seconds)\n");
 	fprintf(stderr, "                      -x           (disable local "
 		"loopback of sent CAN frames)\n");
+	fprintf(stderr, "                      -m <frames>  (send up to <frames> "
+		"due CAN frames with one write)\n");
 	fprintf(stderr, "                      -v           (verbose: print "
 		"sent CAN frames)\n\n");
 	fprintf(stderr, "Interface assignment:  0..n assignments like "
@@ -231,6 +233,35 @@ int add_assignment(char *mode, int socket, char *txname, char *rxname,
 	return 0;
 }
 
+int send_batch(int socket, struct can_raw_batch_frame *bframes, int *nframes)
+{
+	char *pos = (char *)bframes;
+	int len = *nframes * sizeof(struct can_raw_batch_frame);
+	int nbytes;
+
+	*nframes = 0;
+
+	/* resend the frames that have not been accepted by a short write */
+	while (len > 0) {
+		nbytes = write(socket, pos, len);
+		if (nbytes < 0) {
+			perror("write");
+			return 1;
+		}
+
+		if (!nbytes) {
+			fprintf(stderr, "write: none of %d CAN frames accepted\n",
+				(int)(len / sizeof(struct can_raw_batch_frame)));
+			return 1;
+		}
+
+		pos += nbytes;
+		len -= nbytes;
+	}
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	static char buf[BUFSZ], device[BUFSZ], ascframe[BUFSZ];
@@ -246,12 +277,14 @@ int main(int argc, char **argv)
 	static int loopback_disable = 0;
 	static int infinite_loops = 0;
 	static int loops = DEFAULT_LOOPS;
+	static int batch, nframes;
+	struct can_raw_batch_frame *bframes = NULL;
 	int assignments; /* assignments defined on the commandline */
 	int txidx;       /* sendto() interface index */
 	int eof, nbytes, i, j;
 	char *fret;
 
-	while ((opt = getopt(argc, argv, "I:l:tg:s:xv?")) != -1) {
+	while ((opt = getopt(argc, argv, "I:l:tg:s:xm:v?")) != -1) {
 		switch (opt) {
 		case 'I':
 			infile = fopen(optarg, "r");
@@ -291,6 +324,14 @@ int main(int argc, char **argv)
 			loopback_disable = 1;
 			break;
 
+		case 'm':
+			batch = atoi(optarg);
+			if (batch < 1) {
+				fprintf(stderr, "Invalid argument for option -m !\n");
+				return 1;
+			}
+			break;
+
 		case 'v':
 			verbose++;
 			break;
@@ -339,6 +380,22 @@ int main(int argc, char **argv)
 			   &loopback, sizeof(loopback));
 	}
 
+	if (batch) {
+		int batch_type = CAN_RAW_BATCH_IFFRAMES;
+
+		if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_SEND_BATCH,
+			       &batch_type, sizeof(batch_type)) < 0) {
+			perror("setsockopt CAN_RAW_SEND_BATCH");
+			return 1;
+		}
+
+		bframes = calloc(batch, sizeof(struct can_raw_batch_frame));
+		if (!bframes) {
+			perror("calloc");
+			return 1;
+		}
+	}
+
 	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
 		perror("bind");
 		return 1;
@@ -426,6 +483,10 @@ int main(int argc, char **argv)
 
 				if (txidx == STDOUTIDX) { /* hook to print logfile lines on stdout */
 
+					/* keep the order of sent frames and printed lines */
+					if (send_batch(s, bframes, &nframes))
+						return 1;
+
 					printf("%s", buf); /* print the line AS-IS without extra \n */
 					fflush(stdout);
 
@@ -436,15 +497,24 @@ int main(int argc, char **argv)
 						return 1;
 					}
 
-					addr.can_family  = AF_CAN;
-					addr.can_ifindex = txidx; /* send via this interface */
+					if (batch) {
+						/* collect due frames for one write */
+						bframes[nframes].ifindex = txidx;
+						bframes[nframes].frame = frame;
+						if ((++nframes == batch) &&
+						    send_batch(s, bframes, &nframes))
+							return 1;
+					} else {
+						addr.can_family  = AF_CAN;
+						addr.can_ifindex = txidx; /* send via this interface */
  
-					nbytes = sendto(s, &frame, sizeof(struct can_frame), 0,
-							(struct sockaddr*)&addr, sizeof(addr));
+						nbytes = sendto(s, &frame, sizeof(struct can_frame), 0,
+								(struct sockaddr*)&addr, sizeof(addr));
 
-					if (nbytes != sizeof(struct can_frame)) {
-						perror("sendto");
-						return 1;
+						if (nbytes != sizeof(struct can_frame)) {
+							perror("sendto");
+							return 1;
+						}
 					}
 
 					if (verbose) {
@@ -486,6 +556,10 @@ int main(int argc, char **argv)
 
 			} /* while frames_to_send ... */
 
+			/* send the remaining collected frames */
+			if (send_batch(s, bframes, &nframes))
+				return 1;
+
 			if (nanosleep(&sleep_ts, NULL))
 				return 1;
 
@@ -500,6 +574,7 @@ out:
 
 	close(s);
 	fclose(infile);
+	free(bframes);
 
 	if (verbose > 1) /* use -v -v to see this */
 		printf("%d delay_loops\n", delay_loops);
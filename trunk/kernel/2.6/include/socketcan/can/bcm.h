@@ -16,6 +16,28 @@
 #ifndef CAN_BCM_H
 #define CAN_BCM_H
 
+#include <socketcan/can.h>
+
+#define SOL_CAN_BCM (SOL_CAN_BASE + CAN_BCM)
+
+/* for socket options affecting the socket (not the global system) */
+
+enum {
+	CAN_BCM_RX_DIGEST = 1	/* RX_CHANGED digest interval (default:off) */
+};
+
+/*
+ * CAN_BCM_RX_DIGEST takes a struct timeval with the digest interval.
+ * When set the content changes of all rx ops of the socket are collected
+ * and sent as one RX_DIGEST message at the latest one interval after the
+ * first collected change. The CAN frames of the RX_DIGEST message contain
+ * the latest content of each changed rx op (and MUX index) in the order of
+ * their first change. can_id, flags, count and the intervals are zero in the
+ * RX_DIGEST message head. The CAN frames of one RX_DIGEST message are
+ * received on the same interface (see msg_name). A zero interval switches
+ * back to single RX_CHANGED messages.
+ */
+
 /**
  * struct bcm_msg_head - head of messages to/from the broadcast manager
  * @opcode:    opcode, see enum below.
@@ -49,7 +71,8 @@ enum {
 	TX_EXPIRED,	/* notification on performed transmissions (count=0) */
 	RX_STATUS,	/* reply to RX_READ request */
 	RX_TIMEOUT,	/* cyclic message is absent */
-	RX_CHANGED	/* updated CAN frame (detected content change) */
+	RX_CHANGED,	/* updated CAN frame (detected content change) */
+	RX_DIGEST	/* updated CAN frames of several rx ops (digest) */
 };
 
 #define SETTIMER            0x0001
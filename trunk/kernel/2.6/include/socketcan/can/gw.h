@@ -17,6 +17,7 @@
 #define CAN_GW_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 #include <socketcan/can.h>
 
 struct rtcanmsg {
@@ -29,6 +30,7 @@ struct rtcanmsg {
 enum {
 	CGW_TYPE_UNSPEC,
 	CGW_TYPE_CAN_CAN,	/* CAN->CAN routing */
+	CGW_TYPE_CAN_RING,	/* CAN->userspace ring (see CGW_RING_SETUP) */
 	__CGW_TYPE_MAX
 };
 
@@ -48,13 +50,33 @@ enum {
 	CGW_SRC_IF,	/* ifindex of source network interface */
 	CGW_DST_IF,	/* ifindex of destination network interface */
 	CGW_FILTER,	/* specify struct can_filter on source CAN device */
+	CGW_DST_IFS,	/* ifindex array of destination network interfaces */
+	CGW_LIMIT,	/* rate limit & deduplication of forwarded frames */
+	CGW_SUPPRESSED,	/* number of suppressed CAN frames */
+	CGW_LAT_HIST,	/* histogram of the forwarding latency */
+	CGW_CS_CRC,	/* set data[] CRC16/CRC32 checksum into data[index] */
+	CGW_ALIVE_CNT,	/* set an alive counter into data[index] */
+	CGW_RING_ID,	/* id of the destination ring for CGW_TYPE_CAN_RING */
+	CGW_LIM_HOPS,	/* limit the number of hops of this specific job */
+	CGW_DELETED,	/* number of CAN frames deleted due to the hop limit */
+	CGW_HANDLED64,	/* number of handled CAN frames (64 bit) */
+	CGW_DROPPED64,	/* number of dropped CAN frames (64 bit) */
+	CGW_SUPPRESSED64, /* number of suppressed CAN frames (64 bit) */
 	__CGW_MAX
 };
 
 #define CGW_MAX (__CGW_MAX - 1)
 
+#define CGW_DST_MAX 16 /* max. number of destinations in CGW_DST_IFS */
+
 #define CGW_FLAGS_CAN_ECHO 0x01
 #define CGW_FLAGS_CAN_SRC_TSTAMP 0x02
+#define CGW_FLAGS_CAN_LAT_HIST 0x04
+
+#define CGW_LAT_BUCKETS 16 /* number of __u64 values in CGW_LAT_HIST */
+
+#define CGW_MIN_HOPS 1 /* range of the max_hops module parameter */
+#define CGW_MAX_HOPS 6
 
 #define CGW_MOD_FUNCS 4 /* AND OR XOR SET */
 
@@ -92,9 +114,46 @@ struct cgw_csum_crc8 {
 	__u8 profile_data[20];
 } __attribute__((packed));
 
+struct cgw_limit {
+	__u32 rate;	/* max. average rate in frames/s (0 = off) */
+	__u32 burst;	/* max. number of frames sent back-to-back */
+	__u32 interval;	/* min. interval in ms between frames per CAN ID */
+	__u8 flags;
+} __attribute__((packed));
+
+#define CGW_LIMIT_LEN sizeof(struct cgw_limit)
+
+/* forward frames with a changed content regardless of the interval */
+#define CGW_LIMIT_ON_CHANGE 0x01
+
+struct cgw_csum_crc {
+	__s8 from_idx;
+	__s8 to_idx;
+	__s8 result_idx;
+	__u8 width;		/* 16 or 32 bit */
+	__u8 flags;
+	__u8 data_id_len;	/* number of data_id bytes (0 .. 4) */
+	__u32 poly;
+	__u32 init_crc_val;
+	__u32 final_xor_val;
+	__u32 data_id;
+} __attribute__((packed));
+
+/* CRC flags */
+#define CGW_CRC_REFLECTED 0x01	/* reflected (LSB first) CRC algorithm */
+#define CGW_CRC_RESULT_BE 0x02	/* store the CRC with big endian byte order */
+
+struct cgw_alive_cnt {
+	__s8 idx;
+	__u8 mask;
+	__u8 max_val;
+} __attribute__((packed));
+
 /* length of checksum operation parameters. idx = index in CAN frame data[] */
 #define CGW_CS_XOR_LEN  sizeof(struct cgw_csum_xor)
 #define CGW_CS_CRC8_LEN  sizeof(struct cgw_csum_crc8)
+#define CGW_CS_CRC_LEN  sizeof(struct cgw_csum_crc)
+#define CGW_ALIVE_CNT_LEN  sizeof(struct cgw_alive_cnt)
 
 /* CRC8 profiles (compute CRC for additional data elements - see below) */
 enum {
@@ -107,12 +166,67 @@ enum {
 
 #define CGW_CRC8PRF_MAX (__CGW_CRC8PRF_MAX - 1)
 
+/**
+ * struct cgw_ring_req - CGW_RING_SETUP ioctl on an open CGW_RING_DEV file
+ * @slot_nr: number of struct can_raw_ring_slot elements in the ring
+ * @ring_id: id of the ring to be used in CGW_RING_ID (set by the ioctl)
+ *
+ * Description:
+ * Each open file of the gateway ring device can set up one ring which is
+ * mapped into the user space with mmap() (offset 0, length of the slot
+ * array rounded up to the page size). The ring uses the slot layout and the
+ * slot status handling of the CAN_RAW_RX_RING (see socketcan/can/raw.h).
+ * Gateway jobs of the type CGW_TYPE_CAN_RING put the (modified) CAN frames
+ * they receive into the ring given by CGW_RING_ID. poll() indicates POLLIN
+ * when the latest filled slot is not yet consumed. Closing the file removes
+ * the ring and all gateway jobs that are using it.
+ */
+struct cgw_ring_req {
+	__u32 slot_nr;
+	__u32 ring_id;
+};
+
+#define CGW_RING_DEV "/dev/can-gw"
+#define CGW_RING_SETUP _IOWR('C', 0x20, struct cgw_ring_req)
+
 /*
  * CAN rtnetlink attribute contents in detail
  *
+ * CGW_HANDLED, CGW_DROPPED, CGW_SUPPRESSED (length 4 bytes):
+ * __u32 frame counters of the gateway job (lower 32 bits of the totals).
+ *
+ * CGW_HANDLED64, CGW_DROPPED64, CGW_SUPPRESSED64, CGW_DELETED (length 8 bytes):
+ * __u64 frame counters of the gateway job.
+ *
+ * CGW_LIM_HOPS (length 1 byte):
+ * Each CAN frame sent by a gateway job carries a hop counter that is
+ * incremented by every job forwarding it. Frames that already passed
+ * 'max_hops' jobs (module parameter, CGW_MIN_HOPS .. CGW_MAX_HOPS, default 1)
+ * are deleted and counted in CGW_DELETED. This allows routing over several
+ * CAN interfaces of one host (e.g. A -> B -> C with max_hops = 2) while
+ * circular routes terminate. With CGW_LIM_HOPS set to 1 .. max_hops a job
+ * that receives a frame first limits the total number of hops of that frame
+ * to the given value.
+ *
+ * CGW_LAT_HIST (length CGW_LAT_BUCKETS * 8 bytes):
+ * When the job is created with CGW_FLAGS_CAN_LAT_HIST the latency between
+ * the reception timestamp of the CAN frame and passing it to can_send() is
+ * counted in a __u64 histogram. Bucket 0 counts latencies below 1 us and
+ * bucket n covers 2^(n-1) .. 2^n - 1 us. The last bucket counts all higher
+ * latencies.
+ *
  * CGW_XXX_IF (length 4 bytes):
  * Sets an interface index for source/destination network interfaces.
  * For the CAN->CAN gwtype the indices of _two_ CAN interfaces are mandatory.
+ * For the CAN->userspace ring gwtype only the source interface is used.
+ *
+ * CGW_RING_ID (length 4 bytes):
+ * Sets the destination ring for the CGW_TYPE_CAN_RING gwtype (mandatory).
+ *
+ * CGW_DST_IFS (length 4 .. CGW_DST_MAX * 4 bytes):
+ * Sets an array of (distinct) destination interface indices to be used
+ * instead of CGW_DST_IF. The received CAN frame is matched and modified only
+ * once and a clone of the resulting CAN frame is sent to each destination.
  *
  * CGW_FILTER (length 8 bytes):
  * Sets a CAN receive filter for the gateway job specified by the
@@ -125,6 +239,15 @@ enum {
  * <struct can_frame> data used as operator
  * <u8> affected CAN frame elements
  *
+ * CGW_LIMIT (length 13 bytes):
+ * Limits the frames that are forwarded by the gateway job. A token bucket
+ * allows 'rate' frames per second on average and up to 'burst' frames
+ * back-to-back. Additionally frames are tracked per CAN ID: With 'interval'
+ * set a CAN ID is forwarded at most every 'interval' ms and with the flag
+ * CGW_LIMIT_ON_CHANGE frames with a modified dlc/data content are forwarded
+ * in any case. Setting only CGW_LIMIT_ON_CHANGE forwards content changes only.
+ * Suppressed frames are counted in CGW_SUPPRESSED.
+ *
  * CGW_CS_XOR (length 4 bytes):
  * Set a simple XOR checksum starting with an initial value into
  * data[result-idx] using data[start-idx] .. data[end-idx]
@@ -159,6 +282,28 @@ enum {
  * that are used depending on counter values inside the CAN frame data[].
  * So far only three profiles have been implemented for illustration.
  *
+ * CGW_ALIVE_CNT (length 3 bytes):
+ * Sets the value of a job specific counter into the bits 'mask' of data[idx]
+ * of each forwarded CAN frame. The counter runs from 0 to max_val (which has
+ * to fit into the mask) and restarts at 0. Like a CAN frame modification it
+ * is performed before the checksums are calculated.
+ *
+ * CGW_CS_CRC (length 22 bytes):
+ * Set a CRC16 or CRC32 value (width 16/32) into data[result-idx] and the
+ * following bytes using the generator polynomial 'poly', the initial value
+ * init_crc_val and the input data[start-idx] .. data[end-idx] (start-idx <=
+ * end-idx) followed by the lower data_id_len bytes of data_id (LSB first).
+ * Finally the result value is XOR'ed with the final_xor_val and stored in
+ * little endian byte order unless CGW_CRC_RESULT_BE is set.
+ * The parameters follow the usual CRC model with refin = refout which is
+ * selected by CGW_CRC_REFLECTED, e.g. for the AUTOSAR E2E profiles:
+ *
+ * CRC-16/CCITT-FALSE: width 16, poly 0x1021, init 0xFFFF, xor 0
+ * CRC-32/AUTOSAR: width 32, poly 0xF4ACFB13, init 0xFFFFFFFF,
+ *                 xor 0xFFFFFFFF, CGW_CRC_REFLECTED
+ *
+ * The checksums are calculated in the order CRC8 -> CRC -> XOR.
+ *
  * Remark: In general the attribute data is a linear buffer.
  *         Beware of sending unpacked or aligned structs!
  */
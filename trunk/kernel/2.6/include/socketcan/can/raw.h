@@ -27,7 +27,85 @@ enum {
 	CAN_RAW_FILTER = 1,	/* set 0 .. n can_filter(s)          */
 	CAN_RAW_ERR_FILTER,	/* set filter for error frames       */
 	CAN_RAW_LOOPBACK,	/* local loopback (default:on)       */
-	CAN_RAW_RECV_OWN_MSGS	/* receive my own msgs (default:off) */
+	CAN_RAW_RECV_OWN_MSGS,	/* receive my own msgs (default:off) */
+	CAN_RAW_RECV_BATCH,	/* max. frames per read (default:off) */
+	CAN_RAW_SEND_BATCH,	/* frames array per write (default:off) */
+	CAN_RAW_RX_RING,	/* mmap'able rx ring (default:off)   */
+	CAN_RAW_FANOUT		/* shared rx ring size (default:off) */
 };
 
+/* element types for CAN_RAW_SEND_BATCH */
+#define CAN_RAW_BATCH_FRAMES   1 /* array of struct can_frame */
+#define CAN_RAW_BATCH_IFFRAMES 2 /* array of struct can_raw_batch_frame */
+
+/**
+ * struct can_raw_batch_frame - element for CAN_RAW_RECV/SEND_BATCH
+ * @tv_sec:  timestamp of the received frame (seconds)
+ * @tv_usec: timestamp of the received frame (microseconds)
+ * @ifindex: CAN network interface index of the received frame
+ * @flags:   message flags of the received frame (MSG_DONTROUTE/MSG_CONFIRM)
+ * @frame:   the received CAN frame
+ *
+ * Description:
+ * With CAN_RAW_RECV_BATCH set to n > 0 a read operation on the socket
+ * returns up to n received CAN frames as an array of this structure.
+ * The timestamps are only valid when SO_TIMESTAMP is enabled.
+ *
+ * With CAN_RAW_SEND_BATCH set to CAN_RAW_BATCH_IFFRAMES a write operation
+ * sends an array of this structure where only @ifindex and @frame are used.
+ * An @ifindex of zero sends the frame to the default interface of the
+ * socket (see bind() and sendto()).
+ */
+struct can_raw_batch_frame {
+	__u32 tv_sec;
+	__u32 tv_usec;
+	__s32 ifindex;
+	__u32 flags;
+	struct can_frame frame;
+};
+
+/**
+ * struct can_raw_ring_req - CAN_RAW_RX_RING socket option
+ * @slot_nr: number of slots in the rx ring (0 => remove the rx ring)
+ * @drops:   frames dropped due to a full rx ring (only for getsockopt)
+ */
+struct can_raw_ring_req {
+	__u32 slot_nr;
+	__u32 drops;
+};
+
+/* status values of a rx ring slot */
+#define CAN_RAW_SLOT_KERNEL 0 /* slot can be filled by the kernel */
+#define CAN_RAW_SLOT_USER   1 /* slot contains a frame for the user */
+
+/**
+ * struct can_raw_ring_slot - slot of the CAN_RAW_RX_RING
+ * @status: CAN_RAW_SLOT_KERNEL or CAN_RAW_SLOT_USER
+ * @drops:  total number of frames dropped due to a full rx ring
+ * @bf:     the received CAN frame with timestamp, ifindex and msg flags
+ *
+ * Description:
+ * The rx ring is an array of slot_nr slots that is mapped into the user
+ * space with mmap() on the CAN_RAW socket (offset 0, length of the array
+ * rounded up to the page size). While an rx ring is set up all received
+ * CAN frames are put into the ring instead of the socket receive queue.
+ * The user hands back a slot by setting the status to CAN_RAW_SLOT_KERNEL.
+ * poll() indicates POLLIN when the latest filled slot is not yet consumed.
+ */
+struct can_raw_ring_slot {
+	__u32 status;
+	__u32 drops;
+	struct can_raw_batch_frame bf;
+};
+
+/*
+ * CAN_RAW_FANOUT takes an int with the minimum number of CAN frames of a
+ * rx ring that is shared by all CAN_RAW sockets with identical filters,
+ * error mask, interface binding and ring size (0 => off).  Each socket
+ * reads the shared ring with its own read position.  When a socket is
+ * overtaken by the writer the overwritten frames are counted as dropped.
+ * The option has to be set before bind().
+ */
+#define CAN_RAW_FANOUT_MAX (1 << 16) /* max. frames in the shared rx ring */
+
 #endif
@@ -47,6 +47,7 @@
 #include <linux/init.h>
 #include <linux/kmod.h>
 #include <linux/slab.h>
+#include <linux/err.h>
 #include <linux/list.h>
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
@@ -92,7 +93,11 @@ MODULE_PARM_DESC(stats_timer, "enable timer for statistics (default:on)");
 
 HLIST_HEAD(can_rx_dev_list);
 static struct dev_rcv_lists can_rx_alldev_list;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,26)
+static struct hlist_head can_rx_dev_hash[CAN_DEV_HASH_SZ];
+#endif
 static DEFINE_SPINLOCK(can_rcvlists_lock);
+static DEFINE_SPINLOCK(can_pstats_lock);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,20)
 static struct kmem_cache *rcv_cache __read_mostly;
@@ -107,6 +112,7 @@ static DEFINE_MUTEX(proto_tab_lock);
 struct timer_list can_stattimer;   /* timer for statistics update */
 struct s_stats    can_stats;       /* packet statistics */
 struct s_pstats   can_pstats;      /* receive list statistics */
+struct s_cpu_stats *can_cpu_stats; /* per-CPU frame counters */
 
 /*
  * af_can socket functions
@@ -278,6 +284,20 @@ static int can_create(struct socket *sock, int protocol)
  * af_can tx path
  */
 
+/*
+ * can_stats_tx - count sent CAN frames in the per-CPU statistics
+ *
+ * can_send() is used from process and softirq context. Disabling the
+ * bottom halves prevents a softirq on this CPU from interrupting the
+ * non-atomic update of the counter.
+ */
+static inline void can_stats_tx(unsigned long frames)
+{
+	local_bh_disable();
+	per_cpu_ptr(can_cpu_stats, smp_processor_id())->tx_frames += frames;
+	local_bh_enable();
+}
+
 /**
  * can_send - transmit a CAN frame (optional with local loopback)
  * @skb: pointer to socket buffer with CAN frame in data section
@@ -381,17 +401,100 @@ int can_send(struct sk_buff *skb, int loop)
 		netif_rx_ni(newskb);
 
 	/* update statistics */
-	can_stats.tx_frames++;
-	can_stats.tx_frames_delta++;
+	can_stats_tx(1);
 
 	return 0;
 }
 EXPORT_SYMBOL(can_send);
 
+/**
+ * can_send_fwd - forward a batch of received CAN frames without loopback
+ * @queue: socket buffers with CAN frames and the destination in skb->dev
+ *
+ * Fast path for CAN frames that have been checked by can_rcv() and are
+ * forwarded unmodified to other CAN interfaces (e.g. by the CAN gateway).
+ * The frame content and the interface type are not checked again and no
+ * local loopback is done. The frames are handed to the driver queues one
+ * after the other and the statistics are updated once for the batch.
+ * The queue is empty on return.
+ *
+ * Return:
+ *  number of frames that have been accepted by the driver queues
+ */
+int can_send_fwd(struct sk_buff_head *queue)
+{
+	struct sk_buff *skb;
+	int sent = 0;
+	int err;
+
+	while ((skb = __skb_dequeue(queue))) {
+
+		if (!(skb->dev->flags & IFF_UP)) {
+			kfree_skb(skb);
+			continue;
+		}
+
+		skb->protocol = htons(ETH_P_CAN);
+		skb->pkt_type = PACKET_HOST;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,22)
+		skb_reset_network_header(skb);
+		skb_reset_transport_header(skb);
+#else
+		skb->nh.raw = skb->data;
+		skb->h.raw  = skb->data;
+#endif
+
+		/* dev_queue_xmit() consumes the skb in any case */
+		err = dev_queue_xmit(skb);
+		if (err > 0)
+			err = net_xmit_errno(err);
+		if (!err)
+			sent++;
+	}
+
+	if (sent)
+		can_stats_tx(sent);
+
+	return sent;
+}
+EXPORT_SYMBOL(can_send_fwd);
+
 /*
  * af_can rx path
  */
 
+/*
+ * can_link_dev_rcv_lists - make dev_rcv_lists visible for the rx path
+ *
+ * Must be called with can_rcvlists_lock held.
+ */
+static void can_link_dev_rcv_lists(struct dev_rcv_lists *d)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
+	BUG_ON(d->dev->ml_priv);
+	d->dev->ml_priv = d;
+#else
+	hlist_add_head_rcu(&d->hash, &can_rx_dev_hash[dev_rcv_hash(d->dev)]);
+#endif
+	hlist_add_head_rcu(&d->list, &can_rx_dev_list);
+}
+
+/*
+ * can_unlink_dev_rcv_lists - remove dev_rcv_lists from the rx path
+ *
+ * Must be called with can_rcvlists_lock held.
+ * The structure has to be freed after a RCU grace period.
+ */
+static void can_unlink_dev_rcv_lists(struct dev_rcv_lists *d)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
+	d->dev->ml_priv = NULL;
+#else
+	hlist_del_rcu(&d->hash);
+#endif
+	hlist_del_rcu(&d->list);
+}
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
 static struct dev_rcv_lists *find_dev_rcv_lists(struct net_device *dev)
 {
@@ -414,31 +517,120 @@ static struct dev_rcv_lists *find_dev_rcv_lists(struct net_device *dev)
 #else
 static struct dev_rcv_lists *find_dev_rcv_lists(struct net_device *dev)
 {
-	struct dev_rcv_lists *d = NULL;
+	struct dev_rcv_lists *d;
 	struct hlist_node *n;
 
 	/*
 	 * find receive list for this device
 	 *
-	 * The hlist_for_each_entry*() macros curse through the list
-	 * using the pointer variable n and set d to the containing
-	 * struct in each list iteration.  Therefore, after list
-	 * iteration, d is unmodified when the list is empty, and it
-	 * points to last list element, when the list is non-empty
-	 * but no match in the loop body is found.  I.e. d is *not*
-	 * NULL when no match is found.  We can, however, use the
-	 * cursor variable n to decide if a match was found.
+	 * Without the ml_priv pointer the dev_rcv_lists structures are
+	 * additionally hashed by the interface index. This avoids the
+	 * linear walk through the can_rx_dev_list in the rx path.
 	 */
 
-	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
+	/* dev == NULL is the indicator for the 'all' filterlist */
+	if (!dev)
+		return &can_rx_alldev_list;
+
+	hlist_for_each_entry_rcu(d, n, &can_rx_dev_hash[dev_rcv_hash(dev)],
+				 hash) {
 		if (d->dev == dev)
-			break;
+			return d;
 	}
 
-	return n ? d : NULL;
+	return NULL;
 }
 #endif
 
+/**
+ * effhash - hash function for 29 bit CAN identifier reduction
+ * @can_id: 29 bit CAN identifier
+ *
+ * Description:
+ *  To reduce the linear traversal in one linked list of _single_ EFF CAN
+ *  frame subscriptions the 29 bit identifier is mapped to 10 bits.
+ *  (see CAN_EFF_RCV_HASH_BITS definition)
+ *
+ * Return:
+ *  Hash value from 0x000 - 0x3FF ( enforced by CAN_EFF_RCV_HASH_BITS mask )
+ */
+static unsigned int effhash(canid_t can_id)
+{
+	unsigned int hash;
+
+	hash = can_id;
+	hash ^= can_id >> CAN_EFF_RCV_HASH_BITS;
+	hash ^= can_id >> (2 * CAN_EFF_RCV_HASH_BITS);
+
+	return hash & (CAN_EFF_RCV_ARRAY_SZ - 1);
+}
+
+/*
+ * can_rcv_slot_alloc - get the filterlist of a sparse table
+ * @tab: rx_sff or rx_eff block pointer array
+ * @idx: can_id (rx_sff) or hash value (rx_eff)
+ *
+ * Description:
+ *  Allocates the block of filterlists for idx when needed.
+ *  Must be called with the dev_rcv_lists lock held.
+ */
+static struct hlist_head *can_rcv_slot_alloc(struct hlist_head **tab,
+					     unsigned int idx)
+{
+	struct hlist_head *blk = tab[idx >> CAN_RCV_BLK_BITS];
+
+	if (!blk) {
+		/* zeroed memory is the correct hlist_head initialization */
+		blk = kzalloc(CAN_RCV_BLK_SZ * sizeof(*blk), GFP_ATOMIC);
+		if (!blk)
+			return ERR_PTR(-ENOMEM);
+
+		atomic_add(CAN_RCV_BLK_SZ * sizeof(*blk),
+			   &can_pstats.rcv_lists_mem);
+		rcu_assign_pointer(tab[idx >> CAN_RCV_BLK_BITS], blk);
+	}
+
+	return &blk[idx & (CAN_RCV_BLK_SZ - 1)];
+}
+
+/*
+ * can_free_rcv_blocks - free the blocks of single can_id filterlists
+ *
+ * Return:
+ *  Number of freed bytes.
+ */
+static int can_free_rcv_blocks(struct dev_rcv_lists *d)
+{
+	int size = 0;
+	int i;
+
+	for (i = 0; i < CAN_SFF_RCV_BLOCKS; i++) {
+		if (d->rx_sff[i]) {
+			kfree(d->rx_sff[i]);
+			size += CAN_RCV_BLK_SZ * sizeof(struct hlist_head);
+		}
+	}
+
+	for (i = 0; i < CAN_EFF_RCV_BLOCKS; i++) {
+		if (d->rx_eff[i]) {
+			kfree(d->rx_eff[i]);
+			size += CAN_RCV_BLK_SZ * sizeof(struct hlist_head);
+		}
+	}
+
+	return size;
+}
+
+/*
+ * can_free_dev_rcv_lists - free device filter struct and its filterlists
+ */
+static void can_free_dev_rcv_lists(struct dev_rcv_lists *d)
+{
+	atomic_sub(sizeof(*d) + can_free_rcv_blocks(d),
+		   &can_pstats.rcv_lists_mem);
+	kfree(d);
+}
+
 /**
  * find_rcv_list - determine optimal filterlist inside device filter struct
  * @can_id: pointer to CAN identifier of a given can_filter
@@ -463,6 +655,9 @@ static struct dev_rcv_lists *find_dev_rcv_lists(struct net_device *dev)
  *
  * Return:
  *  Pointer to optimal filterlist for the given can_id/mask pair.
+ *  NULL for a can_id/mask filter that is located in a filter group.
+ *  ERR_PTR(-ENOMEM) when a block of the single can_id filterlists can
+ *  not be allocated.
  *  Constistency checked mask.
  *  Reduced can_id to have a preprocessed filter compare value.
  */
@@ -502,18 +697,70 @@ static struct hlist_head *find_rcv_list(canid_t *can_id, canid_t *mask,
 	    && !(*can_id & CAN_RTR_FLAG)) {
 
 		if (*can_id & CAN_EFF_FLAG) {
-			if (*mask == (CAN_EFF_MASK | CAN_EFF_RTR_FLAGS)) {
-				/* RFC: a future use-case for hash-tables? */
-				return &d->rx[RX_EFF];
-			}
+			if (*mask == (CAN_EFF_MASK | CAN_EFF_RTR_FLAGS))
+				return can_rcv_slot_alloc(d->rx_eff,
+							  effhash(*can_id));
 		} else {
 			if (*mask == (CAN_SFF_MASK | CAN_EFF_RTR_FLAGS))
-				return &d->rx_sff[*can_id];
+				return can_rcv_slot_alloc(d->rx_sff, *can_id);
 		}
 	}
 
-	/* default: filter via can_id/can_mask */
-	return &d->rx[RX_FIL];
+	/* default: filter via can_id/can_mask (see find_mask_group()) */
+	return NULL;
+}
+
+/**
+ * filhash - hash function for masked CAN identifiers
+ * @can_id: CAN identifier already reduced by the filter mask
+ *
+ * Return:
+ *  Hash value from 0x00 - 0x3F ( enforced by CAN_FIL_RCV_HASH_BITS mask )
+ */
+static unsigned int filhash(canid_t can_id)
+{
+	unsigned int hash;
+
+	hash = can_id;
+	hash ^= can_id >> CAN_FIL_RCV_HASH_BITS;
+	hash ^= can_id >> (2 * CAN_FIL_RCV_HASH_BITS);
+	hash ^= can_id >> (3 * CAN_FIL_RCV_HASH_BITS);
+	hash ^= can_id >> (4 * CAN_FIL_RCV_HASH_BITS);
+	hash ^= can_id >> (5 * CAN_FIL_RCV_HASH_BITS);
+
+	return hash & (CAN_FIL_RCV_ARRAY_SZ - 1);
+}
+
+/**
+ * find_mask_group - find the can_id/mask filter group for a given mask
+ * @mask: CAN mask (already checked by find_rcv_list())
+ * @d: pointer to the device filter struct
+ *
+ * Description:
+ *  Must be called with the lock of the device filter struct held.
+ *
+ * Return:
+ *  Pointer to the filter group for the given mask value.
+ *  NULL when no filter group with this mask value exists.
+ */
+static struct rcv_mask_group *find_mask_group(canid_t mask,
+					      struct dev_rcv_lists *d)
+{
+	struct rcv_mask_group *g;
+	struct hlist_node *n;
+
+	hlist_for_each_entry(g, n, &d->rx_fil, list) {
+		if (g->mask == mask)
+			return g;
+	}
+
+	return NULL;
+}
+
+static void can_rx_free_receiver(struct receiver *r)
+{
+	free_percpu(r->matches);
+	kmem_cache_free(rcv_cache, r);
 }
 
 /**
@@ -552,6 +799,7 @@ int can_rx_register(struct net_device *dev, canid_t can_id, canid_t mask,
 	struct receiver *r;
 	struct hlist_head *rl;
 	struct dev_rcv_lists *d;
+	struct rcv_mask_group *g;
 	int err = 0;
 
 	/* insert new receiver  (dev,canid,mask) -> (func,data) */
@@ -565,31 +813,73 @@ int can_rx_register(struct net_device *dev, canid_t can_id, canid_t mask,
 	if (!r)
 		return -ENOMEM;
 
-	spin_lock(&can_rcvlists_lock);
+	r->matches = alloc_percpu(unsigned long);
+	if (!r->matches) {
+		kmem_cache_free(rcv_cache, r);
+		return -ENOMEM;
+	}
+
+	/* d is freed by call_rcu() after the removal from can_rx_dev_list */
+	rcu_read_lock();
 
 	d = find_dev_rcv_lists(dev);
-	if (d) {
-		rl = find_rcv_list(&can_id, &mask, d);
-
-		r->can_id  = can_id;
-		r->mask    = mask;
-		r->matches = 0;
-		r->func    = func;
-		r->data    = data;
-		r->ident   = ident;
-
-		hlist_add_head_rcu(&r->list, rl);
-		d->entries++;
-
-		can_pstats.rcv_entries++;
-		if (can_pstats.rcv_entries_max < can_pstats.rcv_entries)
-			can_pstats.rcv_entries_max = can_pstats.rcv_entries;
-	} else {
-		kmem_cache_free(rcv_cache, r);
+	if (!d) {
 		err = -ENODEV;
+		goto out;
 	}
 
-	spin_unlock(&can_rcvlists_lock);
+	spin_lock(&d->lock);
+
+	if (d->dead) {
+		err = -ENODEV;
+		goto out_unlock;
+	}
+
+	rl = find_rcv_list(&can_id, &mask, d);
+	if (IS_ERR(rl)) {
+		err = PTR_ERR(rl);
+		goto out_unlock;
+	}
+
+	if (!rl) {
+		g = find_mask_group(mask, d);
+		if (!g) {
+			/* first can_id/mask filter with this mask */
+			g = kzalloc(sizeof(*g), GFP_ATOMIC);
+			if (!g) {
+				err = -ENOMEM;
+				goto out_unlock;
+			}
+			atomic_add(sizeof(*g), &can_pstats.rcv_lists_mem);
+			g->mask = mask;
+			hlist_add_head_rcu(&g->list, &d->rx_fil);
+		}
+		g->entries++;
+		rl = &g->rx[filhash(can_id)];
+	}
+
+	r->can_id  = can_id;
+	r->mask    = mask;
+	r->func    = func;
+	r->data    = data;
+	r->ident   = ident;
+
+	hlist_add_head_rcu(&r->list, rl);
+	d->entries++;
+
+	spin_lock(&can_pstats_lock);
+	can_pstats.rcv_entries++;
+	if (can_pstats.rcv_entries_max < can_pstats.rcv_entries)
+		can_pstats.rcv_entries_max = can_pstats.rcv_entries;
+	spin_unlock(&can_pstats_lock);
+
+ out_unlock:
+	spin_unlock(&d->lock);
+ out:
+	rcu_read_unlock();
+
+	if (err)
+		can_rx_free_receiver(r);
 
 	return err;
 }
@@ -602,7 +892,18 @@ static void can_rx_delete_device(struct rcu_head *rp)
 {
 	struct dev_rcv_lists *d = container_of(rp, struct dev_rcv_lists, rcu);
 
-	kfree(d);
+	can_free_dev_rcv_lists(d);
+}
+
+/*
+ * can_rx_delete_mask_group - rcu callback for filter group removal
+ */
+static void can_rx_delete_mask_group(struct rcu_head *rp)
+{
+	struct rcv_mask_group *g = container_of(rp, struct rcv_mask_group, rcu);
+
+	atomic_sub(sizeof(*g), &can_pstats.rcv_lists_mem);
+	kfree(g);
 }
 
 /*
@@ -612,7 +913,7 @@ static void can_rx_delete_receiver(struct rcu_head *rp)
 {
 	struct receiver *r = container_of(rp, struct receiver, rcu);
 
-	kmem_cache_free(rcv_cache, r);
+	can_rx_free_receiver(r);
 }
 
 /**
@@ -633,13 +934,15 @@ void can_rx_unregister(struct net_device *dev, canid_t can_id, canid_t mask,
 	struct hlist_head *rl;
 	struct hlist_node *next;
 	struct dev_rcv_lists *d;
+	struct rcv_mask_group *g = NULL;
+	int remove_dev = 0;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
 	if (dev && dev->type != ARPHRD_CAN)
 		return;
 #endif
 
-	spin_lock(&can_rcvlists_lock);
+	rcu_read_lock();
 
 	d = find_dev_rcv_lists(dev);
 	if (!d) {
@@ -649,7 +952,27 @@ void can_rx_unregister(struct net_device *dev, canid_t can_id, canid_t mask,
 		goto out;
 	}
 
+	spin_lock(&d->lock);
+
 	rl = find_rcv_list(&can_id, &mask, d);
+	if (IS_ERR(rl)) {
+		/* the filterlist block for a registered entry is allocated */
+		printk(KERN_ERR "BUG: receive list not found for "
+		       "dev %s, id %03X, mask %03X\n",
+		       DNAME(dev), can_id, mask);
+		goto out_unlock;
+	}
+
+	if (!rl) {
+		g = find_mask_group(mask, d);
+		if (!g) {
+			printk(KERN_ERR "BUG: filter group not found for "
+			       "dev %s, id %03X, mask %03X\n",
+			       DNAME(dev), can_id, mask);
+			goto out_unlock;
+		}
+		rl = &g->rx[filhash(can_id)];
+	}
 
 	/*
 	 * Search the receiver list for the item to delete.  This should
@@ -674,34 +997,52 @@ void can_rx_unregister(struct net_device *dev, canid_t can_id, canid_t mask,
 		       "dev %s, id %03X, mask %03X\n",
 		       DNAME(dev), can_id, mask);
 		r = NULL;
-		d = NULL;
-		goto out;
+		g = NULL;
+		goto out_unlock;
 	}
 
 	hlist_del_rcu(&r->list);
 	d->entries--;
 
+	/* remove filter group when the last can_id/mask filter is gone */
+	if (g && !--g->entries)
+		hlist_del_rcu(&g->list);
+	else
+		g = NULL;
+
+	spin_lock(&can_pstats_lock);
 	if (can_pstats.rcv_entries > 0)
 		can_pstats.rcv_entries--;
+	spin_unlock(&can_pstats_lock);
 
 	/* remove device structure requested by NETDEV_UNREGISTER */
 	if (d->remove_on_zero_entries && !d->entries) {
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
-		dev->ml_priv = NULL;
-#endif
-		hlist_del_rcu(&d->list);
-	} else
-		d = NULL;
+		d->dead = 1;
+		remove_dev = 1;
+	}
+
+ out_unlock:
+	spin_unlock(&d->lock);
+
+	if (remove_dev) {
+		spin_lock(&can_rcvlists_lock);
+		can_unlink_dev_rcv_lists(d);
+		spin_unlock(&can_rcvlists_lock);
+	}
 
  out:
-	spin_unlock(&can_rcvlists_lock);
+	rcu_read_unlock();
 
 	/* schedule the receiver item for deletion */
 	if (r)
 		call_rcu(&r->rcu, can_rx_delete_receiver);
 
+	/* schedule the empty filter group for deletion */
+	if (g)
+		call_rcu(&g->rcu, can_rx_delete_mask_group);
+
 	/* schedule the device structure for deletion */
-	if (d)
+	if (remove_dev)
 		call_rcu(&d->rcu, can_rx_delete_device);
 }
 EXPORT_SYMBOL(can_rx_unregister);
@@ -709,13 +1050,17 @@ EXPORT_SYMBOL(can_rx_unregister);
 static inline void deliver(struct sk_buff *skb, struct receiver *r)
 {
 	r->func(skb, r->data);
-	r->matches++;
+
+	/* called in softirq context => no CPU migration */
+	(*per_cpu_ptr(r->matches, smp_processor_id()))++;
 }
 
 static int can_rcv_filter(struct dev_rcv_lists *d, struct sk_buff *skb)
 {
 	struct receiver *r;
-	struct hlist_node *n;
+	struct rcv_mask_group *g;
+	struct hlist_head *rl;
+	struct hlist_node *n, *m;
 	int matches = 0;
 	struct can_frame *cf = (struct can_frame *)skb->data;
 	canid_t can_id = cf->can_id;
@@ -740,11 +1085,15 @@ static int can_rcv_filter(struct dev_rcv_lists *d, struct sk_buff *skb)
 		matches++;
 	}
 
-	/* check for can_id/mask entries */
-	hlist_for_each_entry_rcu(r, n, &d->rx[RX_FIL], list) {
-		if ((can_id & r->mask) == r->can_id) {
-			deliver(skb, r);
-			matches++;
+	/* check for can_id/mask entries - one hash lookup per mask value */
+	hlist_for_each_entry_rcu(g, n, &d->rx_fil, list) {
+		canid_t id = can_id & g->mask;
+
+		hlist_for_each_entry_rcu(r, m, &g->rx[filhash(id)], list) {
+			if (r->can_id == id) {
+				deliver(skb, r);
+				matches++;
+			}
 		}
 	}
 
@@ -761,15 +1110,22 @@ static int can_rcv_filter(struct dev_rcv_lists *d, struct sk_buff *skb)
 		return matches;
 
 	if (can_id & CAN_EFF_FLAG) {
-		hlist_for_each_entry_rcu(r, n, &d->rx[RX_EFF], list) {
+		rl = can_rcv_slot(d->rx_eff, effhash(can_id));
+		if (!rl)
+			return matches;
+
+		hlist_for_each_entry_rcu(r, n, rl, list) {
 			if (r->can_id == can_id) {
 				deliver(skb, r);
 				matches++;
 			}
 		}
 	} else {
-		can_id &= CAN_SFF_MASK;
-		hlist_for_each_entry_rcu(r, n, &d->rx_sff[can_id], list) {
+		rl = can_rcv_slot(d->rx_sff, can_id & CAN_SFF_MASK);
+		if (!rl)
+			return matches;
+
+		hlist_for_each_entry_rcu(r, n, rl, list) {
 			deliver(skb, r);
 			matches++;
 		}
@@ -788,6 +1144,7 @@ static int can_rcv(struct sk_buff *skb, struct net_device *dev,
 {
 	struct dev_rcv_lists *d;
 	struct can_frame *cf = (struct can_frame *)skb->data;
+	struct s_cpu_stats *stats;
 	int matches;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
@@ -812,9 +1169,10 @@ static int can_rcv(struct sk_buff *skb, struct net_device *dev,
 	       cf->can_dlc > 8);
 #endif
 
+	stats = per_cpu_ptr(can_cpu_stats, smp_processor_id());
+
 	/* update statistics */
-	can_stats.rx_frames++;
-	can_stats.rx_frames_delta++;
+	stats->rx_frames++;
 
 	rcu_read_lock();
 
@@ -835,10 +1193,8 @@ static int can_rcv(struct sk_buff *skb, struct net_device *dev,
 	kfree_skb(skb);
 #endif
 
-	if (matches > 0) {
-		can_stats.matches++;
-		can_stats.matches_delta++;
-	}
+	if (matches > 0)
+		stats->matches++;
 
 	return NET_RX_SUCCESS;
 
@@ -960,14 +1316,12 @@ static int can_notifier(struct notifier_block *nb, unsigned long msg,
 			       "can: allocation of receive list failed\n");
 			return NOTIFY_DONE;
 		}
+		atomic_add(sizeof(*d), &can_pstats.rcv_lists_mem);
+		spin_lock_init(&d->lock);
 		d->dev = dev;
 
 		spin_lock(&can_rcvlists_lock);
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
-		BUG_ON(dev->ml_priv);
-		dev->ml_priv = d;
-#endif
-		hlist_add_head_rcu(&d->list, &can_rx_dev_list);
+		can_link_dev_rcv_lists(d);
 		spin_unlock(&can_rcvlists_lock);
 
 		break;
@@ -977,14 +1331,15 @@ static int can_notifier(struct notifier_block *nb, unsigned long msg,
 
 		d = find_dev_rcv_lists(dev);
 		if (d) {
+			spin_lock(&d->lock);
 			if (d->entries) {
 				d->remove_on_zero_entries = 1;
+				spin_unlock(&d->lock);
 				d = NULL;
 			} else {
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
-				dev->ml_priv = NULL;
-#endif
-				hlist_del_rcu(&d->list);
+				d->dead = 1;
+				spin_unlock(&d->lock);
+				can_unlink_dev_rcv_lists(d);
 			}
 		} else
 			printk(KERN_ERR "can: notifier: receive list not "
@@ -1040,12 +1395,21 @@ static __init int can_init(void)
 	if (!rcv_cache)
 		return -ENOMEM;
 
+	can_cpu_stats = alloc_percpu(struct s_cpu_stats);
+	if (!can_cpu_stats) {
+		kmem_cache_destroy(rcv_cache);
+		return -ENOMEM;
+	}
+
 	/*
 	 * Insert can_rx_alldev_list for reception on all devices.
 	 * This struct is zero initialized which is correct for the
 	 * embedded hlist heads, the dev pointer, and the entries counter.
 	 */
 
+	spin_lock_init(&can_rx_alldev_list.lock);
+	atomic_set(&can_pstats.rcv_lists_mem, sizeof(can_rx_alldev_list));
+
 	spin_lock(&can_rcvlists_lock);
 	hlist_add_head_rcu(&can_rx_alldev_list.list, &can_rx_dev_list);
 	spin_unlock(&can_rcvlists_lock);
@@ -1085,13 +1449,14 @@ static __exit void can_exit(void)
 	/* remove can_rx_dev_list */
 	spin_lock(&can_rcvlists_lock);
 	hlist_del(&can_rx_alldev_list.list);
+	can_free_rcv_blocks(&can_rx_alldev_list);
 	hlist_for_each_entry_safe(d, n, next, &can_rx_dev_list, list) {
 		hlist_del(&d->list);
 		BUG_ON(d->entries);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
 		d->dev->ml_priv = NULL;
 #endif
-		kfree(d);
+		can_free_dev_rcv_lists(d);
 	}
 	spin_unlock(&can_rcvlists_lock);
 
@@ -1100,6 +1465,7 @@ static __exit void can_exit(void)
 #endif
 
 	kmem_cache_destroy(rcv_cache);
+	free_percpu(can_cpu_stats);
 }
 
 module_init(can_init);
@@ -44,10 +44,12 @@
 #ifndef AF_CAN_H
 #define AF_CAN_H
 
+#include <linux/version.h>
 #include <linux/skbuff.h>
 #include <linux/netdevice.h>
 #include <linux/list.h>
 #include <linux/rcupdate.h>
+#include <linux/percpu.h>
 #include <socketcan/can.h>
 
 /* af_can rx dispatcher structures */
@@ -57,24 +59,100 @@ struct receiver {
 	struct rcu_head rcu;
 	canid_t can_id;
 	canid_t mask;
-	unsigned long matches;
+	unsigned long *matches; /* per-CPU match counter */
 	void (*func)(struct sk_buff *, void *);
 	void *data;
 	char *ident;
 };
 
-enum { RX_ERR, RX_ALL, RX_FIL, RX_INV, RX_EFF, RX_MAX };
+enum { RX_ERR, RX_ALL, RX_INV, RX_MAX };
+
+/* hash table size for the subscription of single EFF can_ids */
+#define CAN_EFF_RCV_HASH_BITS 10
+#define CAN_EFF_RCV_ARRAY_SZ (1 << CAN_EFF_RCV_HASH_BITS)
+
+/* hash table size for the can_id/mask filters sharing the same mask */
+#define CAN_FIL_RCV_HASH_BITS 6
+#define CAN_FIL_RCV_ARRAY_SZ (1 << CAN_FIL_RCV_HASH_BITS)
 
+/*
+ * The filterlists for single SFF and (hashed) EFF can_ids are sparse
+ * two-level tables: Blocks of CAN_RCV_BLK_SZ hlist heads are allocated on
+ * the first subscription of a can_id inside the block and are freed with
+ * the dev_rcv_lists structure. Devices without single can_id subscribers
+ * only need the small arrays of block pointers.
+ */
+#define CAN_RCV_BLK_BITS 7
+#define CAN_RCV_BLK_SZ (1 << CAN_RCV_BLK_BITS)
+#define CAN_SFF_RCV_ARRAY_SZ (CAN_SFF_MASK + 1)
+#define CAN_SFF_RCV_BLOCKS (CAN_SFF_RCV_ARRAY_SZ >> CAN_RCV_BLK_BITS)
+#define CAN_EFF_RCV_BLOCKS (CAN_EFF_RCV_ARRAY_SZ >> CAN_RCV_BLK_BITS)
+
+/*
+ * can_id/mask filters are grouped by their mask value. In the rx path
+ * the received can_id is masked once per group and only the hash bucket
+ * of the masked can_id has to be checked for matching receivers.
+ */
+struct rcv_mask_group {
+	struct hlist_node list;
+	struct rcu_head rcu;
+	canid_t mask;
+	int entries;
+	struct hlist_head rx[CAN_FIL_RCV_ARRAY_SZ];
+};
+
+/*
+ * The receive lists of a device are modified under the lock of the
+ * dev_rcv_lists structure. The global can_rcvlists_lock only protects the
+ * can_rx_dev_list and the creation/removal of dev_rcv_lists structures.
+ * Lock order: can_rcvlists_lock -> dev_rcv_lists.lock
+ */
 struct dev_rcv_lists {
 	struct hlist_node list;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,26)
+	struct hlist_node hash; /* entry in can_rx_dev_hash (no ml_priv) */
+#endif
 	struct rcu_head rcu;
+	spinlock_t lock;
 	struct net_device *dev;
 	struct hlist_head rx[RX_MAX];
-	struct hlist_head rx_sff[0x800];
+	struct hlist_head rx_fil; /* list of struct rcv_mask_group */
+	struct hlist_head *rx_sff[CAN_SFF_RCV_BLOCKS];
+	struct hlist_head *rx_eff[CAN_EFF_RCV_BLOCKS];
 	int remove_on_zero_entries;
+	int dead; /* removed from can_rx_dev_list => no new entries */
 	int entries;
 };
 
+/*
+ * can_rcv_slot - get the filterlist for an index of a sparse table
+ * @tab: rx_sff or rx_eff block pointer array
+ * @idx: can_id (rx_sff) or hash value (rx_eff)
+ *
+ * Must be called under rcu_read_lock() or with the dev_rcv_lists lock held.
+ *
+ * Return:
+ *  Pointer to the filterlist or NULL when the block is not allocated.
+ */
+static inline struct hlist_head *can_rcv_slot(struct hlist_head **tab,
+					      unsigned int idx)
+{
+	struct hlist_head *blk = rcu_dereference(tab[idx >> CAN_RCV_BLK_BITS]);
+
+	return blk ? &blk[idx & (CAN_RCV_BLK_SZ - 1)] : NULL;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,26)
+/* hash table size for the dev_rcv_lists lookup by interface index */
+#define CAN_DEV_HASH_BITS 5
+#define CAN_DEV_HASH_SZ (1 << CAN_DEV_HASH_BITS)
+
+static inline unsigned int dev_rcv_hash(struct net_device *dev)
+{
+	return dev->ifindex & (CAN_DEV_HASH_SZ - 1);
+}
+#endif
+
 /* statistic structures */
 
 /* can be reset e.g. by can_init_stats() */
@@ -102,12 +180,23 @@ struct s_stats {
 	unsigned long matches_delta;
 };
 
+/*
+ * Frame counters updated in the tx/rx path. They are kept per CPU to avoid
+ * cache line bouncing and are summed up by can_sum_stats() in proc.c.
+ */
+struct s_cpu_stats {
+	unsigned long rx_frames;
+	unsigned long tx_frames;
+	unsigned long matches;
+};
+
 /* persistent statistics */
 struct s_pstats {
 	unsigned long stats_reset;
 	unsigned long user_reset;
 	unsigned long rcv_entries;
 	unsigned long rcv_entries_max;
+	atomic_t rcv_lists_mem; /* memory of the receive list structures */
 };
 
 /* function prototypes for the CAN networklayer procfs (proc.c) */
@@ -119,6 +208,19 @@ extern void can_stat_update(unsigned long data);
 extern struct timer_list can_stattimer;    /* timer for statistics update */
 extern struct s_stats    can_stats;        /* packet statistics */
 extern struct s_pstats   can_pstats;       /* receive list statistics */
+extern struct s_cpu_stats *can_cpu_stats;  /* per-CPU frame counters */
 extern struct hlist_head can_rx_dev_list;  /* rx dispatcher structures */
 
+/* sum up the per-CPU match counter of a receiver */
+static inline unsigned long can_rcv_matches(struct receiver *r)
+{
+	unsigned long matches = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		matches += *per_cpu_ptr(r->matches, cpu);
+
+	return matches;
+}
+
 #endif /* AF_CAN_H */
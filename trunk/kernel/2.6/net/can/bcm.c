@@ -47,6 +47,7 @@
 #include <linux/interrupt.h>
 #include <linux/hrtimer.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
 #include <linux/proc_fs.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
 #include <linux/seq_file.h>
@@ -57,6 +58,11 @@
 #include <linux/socket.h>
 #include <linux/if_arp.h>
 #include <linux/skbuff.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,18)
+#include <linux/uaccess.h>
+#else
+#include <asm/uaccess.h>
+#endif
 #include <socketcan/can.h>
 #include <socketcan/can/core.h>
 #include <socketcan/can/bcm.h>
@@ -83,6 +89,32 @@ RCSID("$Id$");
 #define RX_THR     0x80 /* element not been sent due to throttle feature */
 #define BCM_CAN_DLC_MASK 0x0F /* clean private flags in can_dlc by masking */
 
+/*
+ * Multiplex rx ops with a MUX-mask that fits into one 8 bit window get a
+ * direct index from the masked MUX value to the first fitting frame.
+ */
+#define BCM_MUX_IDX_SIZE 256
+
+/* max. number of CAN frames in one RX_DIGEST message */
+#define BCM_DIGEST_MAX 256
+
+/*
+ * Cyclic tx ops of a socket with the same interface share the hrtimer and
+ * the tasklet of a transmit scheduler when the scheduler tick (the greatest
+ * common divisor of their intervals) is not below BCM_TX_SCHED_MIN_TICK.
+ */
+#define BCM_TX_SCHED_MIN_TICK 1000 /* us */
+#define BCM_TX_SCHED_MAX_IVAL 0xFFFFFFFFUL /* us */
+
+/*
+ * The rx and tx ops of a socket are additionally indexed by (can_id, ifindex)
+ * for a fast lookup when updating, reading or deleting a single op.
+ * The hash table starts with BCM_HASH_MIN_BITS embedded buckets and is
+ * doubled up to BCM_HASH_MAX_BITS when it holds more ops than buckets.
+ */
+#define BCM_HASH_MIN_BITS 3
+#define BCM_HASH_MAX_BITS 12
+
 /* get best masking value for can_rx_register() for a given single can_id */
 #define REGMASK(id) ((id & CAN_EFF_FLAG) ? \
 		     (CAN_EFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG) : \
@@ -110,6 +142,10 @@ static inline u64 GET_U64(const struct can_frame *cp)
 
 struct bcm_op {
 	struct list_head list;
+	struct hlist_node hlist;
+	struct list_head sched_list;
+	struct bcm_tx_sched *sched;
+	u32 sched_ticks, sched_cnt;
 	int ifindex;
 	canid_t can_id;
 	u32 flags;
@@ -126,10 +162,53 @@ struct bcm_op {
 	struct can_frame *last_frames;
 	struct can_frame sframe;
 	struct can_frame last_sframe;
+	u16 *mux_idx;
+	unsigned int mux_shift;
+	int mux_direct;
+	/* elements in the pending RX_DIGEST - protected by digest_lock */
+	DECLARE_BITMAP(digest_map, MAX_NFRAMES + 1);
 	struct sock *sk;
 	struct net_device *rx_reg_dev;
 };
 
+/*
+ * transmit scheduler for cyclic tx ops with harmonic intervals
+ *
+ * The tx ops in the ops list are sent every sched_ticks scheduler ticks.
+ * The list, the op counters and the cached device are protected by the
+ * lock as they are modified in process context and used in the tasklet.
+ * The pool holds preallocated skbs for the frames of the next tick.
+ */
+struct bcm_tx_sched {
+	struct list_head list;
+	struct list_head ops;
+	spinlock_t lock;
+	int ifindex;
+	struct net_device *dev;
+	struct sk_buff_head pool;
+	unsigned int op_num;
+	unsigned long tick; /* us */
+	ktime_t kt_tick, kt_due;
+	struct hrtimer timer;
+	struct tasklet_struct tsklet;
+	atomic_t pending;
+	unsigned long ticks_run, ticks_lost;
+	unsigned long jitter_max, jitter_sum; /* us */
+};
+
+/* changed element of a rx op in the pending RX_DIGEST */
+struct bcm_digest_entry {
+	struct bcm_op *op;
+	unsigned int index;
+};
+
+struct bcm_hash {
+	struct hlist_head *heads;  /* small or allocated table */
+	unsigned int bits;         /* 1 << bits hash buckets */
+	unsigned int count;        /* number of hashed ops */
+	struct hlist_head small[1 << BCM_HASH_MIN_BITS];
+};
+
 static struct proc_dir_entry *proc_dir;
 
 struct bcm_sock {
@@ -139,7 +218,19 @@ struct bcm_sock {
 	struct notifier_block notifier;
 	struct list_head rx_ops;
 	struct list_head tx_ops;
+	struct bcm_hash rx_hash;
+	struct bcm_hash tx_hash;
+	struct list_head tx_scheds;
 	unsigned long dropped_usr_msgs;
+	/* RX_DIGEST handling - protected by digest_lock */
+	spinlock_t digest_lock;
+	struct timeval digest_ival;
+	ktime_t kt_digest, digest_stamp;
+	struct bcm_digest_entry *digest;
+	unsigned int digest_cnt;
+	int digest_ifindex;
+	struct hrtimer digest_timer;
+	struct tasklet_struct digest_tsklet;
 	struct proc_dir_entry *bcm_proc_read;
 	char procname [32]; /* inode number in decimal with \0 */
 };
@@ -181,6 +272,7 @@ static int bcm_proc_show(struct seq_file *m, void *v)
 	struct sock *sk = (struct sock *)m->private;
 	struct bcm_sock *bo = bcm_sk(sk);
 	struct bcm_op *op;
+	struct bcm_tx_sched *ts;
 
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,0,0)
 	seq_printf(m, ">>> socket %p", sk->sk_socket);
@@ -193,6 +285,9 @@ static int bcm_proc_show(struct seq_file *m, void *v)
 #endif
 	seq_printf(m, " / dropped %lu", bo->dropped_usr_msgs);
 	seq_printf(m, " / bound %s", bcm_proc_getifname(ifname, bo->ifindex));
+	if (bo->kt_digest.tv64)
+		seq_printf(m, " / digest %lld",
+			   (long long) ktime_to_us(bo->kt_digest));
 	seq_printf(m, " <<<\n");
 
 	list_for_each_entry(op, &bo->rx_ops, list) {
@@ -243,6 +338,22 @@ static int bcm_proc_show(struct seq_file *m, void *v)
 
 		seq_printf(m, "# sent %ld\n", op->frames_abs);
 	}
+
+	list_for_each_entry(ts, &bo->tx_scheds, list) {
+
+		seq_printf(m, "tx_sched: %s tick=%lu [%u] ",
+				bcm_proc_getifname(ifname, ts->ifindex),
+				ts->tick, ts->op_num);
+
+		seq_printf(m, "# ticks %lu lost %lu ",
+				ts->ticks_run, ts->ticks_lost);
+
+		/* prevent division by zero */
+		seq_printf(m, "=> jitter: avg %lu max %lu\n",
+				ts->ticks_run ?
+				ts->jitter_sum / ts->ticks_run : 0,
+				ts->jitter_max);
+	}
 	seq_putc(m, '\n');
 	return 0;
 }
@@ -268,6 +379,7 @@ static int bcm_read_proc(char *page, char **start, off_t off,
 	struct sock *sk = (struct sock *)data;
 	struct bcm_sock *bo = bcm_sk(sk);
 	struct bcm_op *op;
+	struct bcm_tx_sched *ts;
 
 	len += snprintf(page + len, PAGE_SIZE - len, ">>> socket %p",
 			sk->sk_socket);
@@ -277,6 +389,9 @@ static int bcm_read_proc(char *page, char **start, off_t off,
 			bo->dropped_usr_msgs);
 	len += snprintf(page + len, PAGE_SIZE - len, " / bound %s",
 			bcm_proc_getifname(ifname, bo->ifindex));
+	if (bo->kt_digest.tv64)
+		len += snprintf(page + len, PAGE_SIZE - len, " / digest %lld",
+				(long long) ktime_to_us(bo->kt_digest));
 	len += snprintf(page + len, PAGE_SIZE - len, " <<<\n");
 
 	list_for_each_entry(op, &bo->rx_ops, list) {
@@ -347,6 +462,28 @@ static int bcm_read_proc(char *page, char **start, off_t off,
 		}
 	}
 
+	list_for_each_entry(ts, &bo->tx_scheds, list) {
+
+		if (len > PAGE_SIZE - 100)
+			break;
+
+		len += snprintf(page + len, PAGE_SIZE - len,
+				"tx_sched: %s tick=%lu [%u] ",
+				bcm_proc_getifname(ifname, ts->ifindex),
+				ts->tick, ts->op_num);
+
+		len += snprintf(page + len, PAGE_SIZE - len,
+				"# ticks %lu lost %lu ",
+				ts->ticks_run, ts->ticks_lost);
+
+		/* prevent division by zero */
+		len += snprintf(page + len, PAGE_SIZE - len,
+				"=> jitter: avg %lu max %lu\n",
+				ts->ticks_run ?
+				ts->jitter_sum / ts->ticks_run : 0,
+				ts->jitter_max);
+	}
+
 	len += snprintf(page + len, PAGE_SIZE - len, "\n");
 
 	*eof = 1;
@@ -354,6 +491,24 @@ static int bcm_read_proc(char *page, char **start, off_t off,
 }
 #endif
 
+/*
+ * bcm_tx_fill_skb - copy the (next) CAN frame of the given bcm tx op into
+ *                   the skb and advance to the following frame
+ */
+static void bcm_tx_fill_skb(struct bcm_op *op, struct sk_buff *skb)
+{
+	memcpy(skb_put(skb, CFSIZ), &op->frames[op->currframe], CFSIZ);
+	skb->sk = op->sk;
+
+	/* update statistics */
+	op->currframe++;
+	op->frames_abs++;
+
+	/* reached last frame? */
+	if (op->currframe >= op->nframes)
+		op->currframe = 0;
+}
+
 /*
  * bcm_can_tx - send the (next) CAN frame to the appropriate CAN interface
  *              of the given bcm tx op
@@ -362,7 +517,6 @@ static void bcm_can_tx(struct bcm_op *op)
 {
 	struct sk_buff *skb;
 	struct net_device *dev;
-	struct can_frame *cf = &op->frames[op->currframe];
 
 	/* no target device? => exit */
 	if (!op->ifindex)
@@ -378,24 +532,47 @@ static void bcm_can_tx(struct bcm_op *op)
 	if (!skb)
 		goto out;
 
-	memcpy(skb_put(skb, CFSIZ), cf, CFSIZ);
+	bcm_tx_fill_skb(op, skb);
 
 	/* send with loopback */
 	skb->dev = dev;
-	skb->sk = op->sk;
 	can_send(skb, 1);
-
-	/* update statistics */
-	op->currframe++;
-	op->frames_abs++;
-
-	/* reached last frame? */
-	if (op->currframe >= op->nframes)
-		op->currframe = 0;
  out:
 	dev_put(dev);
 }
 
+/*
+ * bcm_queue_to_user - queue a BCM message skb to the socket receive queue
+ */
+static void bcm_queue_to_user(struct sock *sk, struct sk_buff *skb,
+			      int ifindex)
+{
+	struct sockaddr_can *addr;
+	int err;
+
+	/*
+	 *  Put the datagram to the queue so that bcm_recvmsg() can
+	 *  get it from there.  We need to pass the interface index to
+	 *  bcm_recvmsg().  We pass a whole struct sockaddr_can in skb->cb
+	 *  containing the interface index.
+	 */
+
+	BUILD_BUG_ON(sizeof(skb->cb) < sizeof(struct sockaddr_can));
+	addr = (struct sockaddr_can *)skb->cb;
+	memset(addr, 0, sizeof(*addr));
+	addr->can_family  = AF_CAN;
+	addr->can_ifindex = ifindex;
+
+	err = sock_queue_rcv_skb(sk, skb);
+	if (err < 0) {
+		struct bcm_sock *bo = bcm_sk(sk);
+
+		kfree_skb(skb);
+		/* don't care about overflows in this statistic */
+		bo->dropped_usr_msgs++;
+	}
+}
+
 /*
  * bcm_send_to_user - send a BCM message to the userspace
  *                    (consisting of bcm_msg_head + x CAN frames)
@@ -405,10 +582,7 @@ static void bcm_send_to_user(struct bcm_op *op, struct bcm_msg_head *head,
 {
 	struct sk_buff *skb;
 	struct can_frame *firstframe;
-	struct sockaddr_can *addr;
-	struct sock *sk = op->sk;
 	unsigned int datalen = head->nframes * CFSIZ;
-	int err;
 
 	skb = alloc_skb(sizeof(*head) + datalen, gfp_any());
 	if (!skb)
@@ -437,27 +611,152 @@ static void bcm_send_to_user(struct bcm_op *op, struct bcm_msg_head *head,
 		skb->tstamp = op->rx_stamp;
 	}
 
-	/*
-	 *  Put the datagram to the queue so that bcm_recvmsg() can
-	 *  get it from there.  We need to pass the interface index to
-	 *  bcm_recvmsg().  We pass a whole struct sockaddr_can in skb->cb
-	 *  containing the interface index.
-	 */
+	bcm_queue_to_user(op->sk, skb, op->rx_ifindex);
+}
 
-	BUILD_BUG_ON(sizeof(skb->cb) < sizeof(struct sockaddr_can));
-	addr = (struct sockaddr_can *)skb->cb;
-	memset(addr, 0, sizeof(*addr));
-	addr->can_family  = AF_CAN;
-	addr->can_ifindex = op->rx_ifindex;
+/*
+ * bcm_rx_digest_flush - send the pending RX_DIGEST (digest_lock held)
+ *
+ * Elements that have been cleared in the meantime (last_frames cleared by
+ * RX_SETUP or RX_ANNOUNCE_RESUME) are skipped.
+ */
+static void bcm_rx_digest_flush(struct bcm_sock *bo)
+{
+	struct bcm_msg_head *head = NULL;
+	struct can_frame *cf;
+	struct sk_buff *skb;
+	unsigned int i;
 
-	err = sock_queue_rcv_skb(sk, skb);
-	if (err < 0) {
-		struct bcm_sock *bo = bcm_sk(sk);
+	if (!bo->digest_cnt)
+		return;
 
-		kfree_skb(skb);
+	skb = alloc_skb(sizeof(*head) + bo->digest_cnt * CFSIZ, GFP_ATOMIC);
+	if (skb) {
+		head = (struct bcm_msg_head *)skb_put(skb, sizeof(*head));
+		memset(head, 0, sizeof(*head));
+		head->opcode = RX_DIGEST;
+	} else {
 		/* don't care about overflows in this statistic */
 		bo->dropped_usr_msgs++;
 	}
+
+	for (i = 0; i < bo->digest_cnt; i++) {
+		struct bcm_op *op = bo->digest[i].op;
+		unsigned int index = bo->digest[i].index;
+		struct can_frame *frame = &op->last_frames[index];
+
+		/* this element can be collected again */
+		__clear_bit(index, op->digest_map);
+
+		if (!skb || index >= op->nframes ||
+		    !(frame->can_dlc & RX_RECV))
+			continue;
+
+		cf = (struct can_frame *)skb_put(skb, CFSIZ);
+		memcpy(cf, frame, CFSIZ);
+		cf->can_dlc &= BCM_CAN_DLC_MASK;
+		head->nframes++;
+	}
+
+	bo->digest_cnt = 0;
+
+	if (!skb)
+		return;
+
+	if (!head->nframes) {
+		kfree_skb(skb);
+		return;
+	}
+
+	skb->tstamp = bo->digest_stamp;
+	bcm_queue_to_user(&bo->sk, skb, bo->digest_ifindex);
+}
+
+/*
+ * bcm_rx_digest_add - collect a changed element for the RX_DIGEST
+ *                     (returns 0 when RX_DIGEST is not enabled)
+ */
+static int bcm_rx_digest_add(struct bcm_op *op, struct can_frame *data)
+{
+	struct bcm_sock *bo = bcm_sk(op->sk);
+	struct bcm_digest_entry *entry;
+	unsigned int index = data - op->last_frames;
+
+	spin_lock_bh(&bo->digest_lock);
+
+	if (!bo->digest) {
+		spin_unlock_bh(&bo->digest_lock);
+		return 0;
+	}
+
+	bo->digest_stamp = op->rx_stamp;
+
+	/* already collected => the latest content is sent anyway */
+	if (test_bit(index, op->digest_map))
+		goto out;
+
+	/* one RX_DIGEST contains only CAN frames from one interface */
+	if (bo->digest_cnt && bo->digest_ifindex != op->rx_ifindex)
+		bcm_rx_digest_flush(bo);
+
+	entry = &bo->digest[bo->digest_cnt++];
+	entry->op = op;
+	entry->index = index;
+	__set_bit(index, op->digest_map);
+	bo->digest_ifindex = op->rx_ifindex;
+
+	if (bo->digest_cnt == 1)
+		hrtimer_start(&bo->digest_timer, bo->kt_digest,
+			      HRTIMER_MODE_REL);
+	else if (bo->digest_cnt == BCM_DIGEST_MAX)
+		bcm_rx_digest_flush(bo);
+ out:
+	spin_unlock_bh(&bo->digest_lock);
+	return 1;
+}
+
+/*
+ * bcm_rx_digest_purge - remove the collected elements of a rx op
+ */
+static void bcm_rx_digest_purge(struct bcm_op *op)
+{
+	struct bcm_sock *bo = bcm_sk(op->sk);
+	unsigned int i, n = 0;
+
+	spin_lock_bh(&bo->digest_lock);
+
+	for (i = 0; i < bo->digest_cnt; i++) {
+		if (bo->digest[i].op == op) {
+			__clear_bit(bo->digest[i].index, op->digest_map);
+			continue;
+		}
+		bo->digest[n++] = bo->digest[i];
+	}
+	bo->digest_cnt = n;
+
+	spin_unlock_bh(&bo->digest_lock);
+}
+
+static void bcm_rx_digest_tsklet(unsigned long data)
+{
+	struct bcm_sock *bo = (struct bcm_sock *)data;
+
+	spin_lock_bh(&bo->digest_lock);
+	bcm_rx_digest_flush(bo);
+	spin_unlock_bh(&bo->digest_lock);
+}
+
+/*
+ * bcm_rx_digest_handler - the RX_DIGEST interval has elapsed
+ */
+static enum hrtimer_restart bcm_rx_digest_handler(struct hrtimer *hrtimer)
+{
+	struct bcm_sock *bo = container_of(hrtimer, struct bcm_sock,
+					   digest_timer);
+
+	tasklet_schedule(&bo->digest_tsklet);
+
+	return HRTIMER_NORESTART;
 }
 
 static void bcm_tx_start_timer(struct bcm_op *op)
@@ -513,6 +812,291 @@ static enum hrtimer_restart bcm_tx_timeout_handler(struct hrtimer *hrtimer)
 	return HRTIMER_NORESTART;
 }
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,28)
+/* is part of linux/hrtimer.h since 2.6.28 */
+static inline ktime_t hrtimer_get_expires(const struct hrtimer *timer)
+{
+	return timer->expires;
+}
+#endif
+
+static unsigned long bcm_gcd(unsigned long a, unsigned long b)
+{
+	unsigned long r;
+
+	while (b) {
+		r = a % b;
+		a = b;
+		b = r;
+	}
+
+	return a;
+}
+
+/*
+ * bcm_tx_sched_fill - preallocate one skb per scheduled tx op
+ */
+static void bcm_tx_sched_fill(struct bcm_tx_sched *ts, gfp_t gfp)
+{
+	struct sk_buff *skb;
+
+	while (skb_queue_len(&ts->pool) < ts->op_num) {
+		skb = alloc_skb(CFSIZ, gfp);
+		if (!skb)
+			break;
+		skb_queue_tail(&ts->pool, skb);
+	}
+}
+
+/*
+ * bcm_tx_sched_tsklet - send the frames of all scheduled tx ops that are due
+ *
+ * The frames are put into pool skbs under the lock and are sent together
+ * afterwards. The pool is refilled when the frames are on their way.
+ */
+static void bcm_tx_sched_tsklet(unsigned long data)
+{
+	struct bcm_tx_sched *ts = (struct bcm_tx_sched *)data;
+	struct sk_buff_head queue;
+	struct net_device *dev;
+	struct sk_buff *skb;
+	struct bcm_op *op;
+	unsigned long delay;
+	u32 ticks;
+
+	ticks = atomic_xchg(&ts->pending, 0);
+	if (!ticks)
+		return;
+
+	__skb_queue_head_init(&queue);
+
+	spin_lock(&ts->lock);
+
+	/* (re)lookup the device when it was not available so far */
+	if (!ts->dev && ts->ifindex)
+		ts->dev = dev_get_by_index(&init_net, ts->ifindex);
+
+	dev = ts->dev;
+
+	/* delay of this transmission against the latest due tick */
+	delay = ktime_to_us(ktime_sub(ktime_get(), ts->kt_due));
+
+	/* don't care about overflows in these statistics */
+	ts->ticks_run++;
+	ts->ticks_lost += ticks - 1;
+	ts->jitter_sum += delay;
+	if (delay > ts->jitter_max)
+		ts->jitter_max = delay;
+
+	list_for_each_entry(op, &ts->ops, sched_list) {
+
+		if (op->sched_cnt > ticks) {
+			op->sched_cnt -= ticks;
+			continue;
+		}
+
+		/* send once and stay on the tick grid after lost ticks */
+		op->sched_cnt = op->sched_ticks -
+			(ticks - op->sched_cnt) % op->sched_ticks;
+
+		/* no target device? => no transmission */
+		if (!dev)
+			continue;
+
+		skb = skb_dequeue(&ts->pool);
+		if (!skb) {
+			skb = alloc_skb(CFSIZ, GFP_ATOMIC);
+			if (!skb)
+				continue;
+		}
+
+		bcm_tx_fill_skb(op, skb);
+		skb->dev = dev;
+		__skb_queue_tail(&queue, skb);
+	}
+
+	/* keep the device for the transmission outside the lock */
+	if (!skb_queue_empty(&queue))
+		dev_hold(dev);
+
+	spin_unlock(&ts->lock);
+
+	if (skb_queue_empty(&queue))
+		return;
+
+	/* send with loopback */
+	while ((skb = __skb_dequeue(&queue)))
+		can_send(skb, 1);
+
+	dev_put(dev);
+
+	bcm_tx_sched_fill(ts, GFP_ATOMIC);
+}
+
+/*
+ * bcm_tx_sched_handler - tick of the transmit scheduler
+ */
+static enum hrtimer_restart bcm_tx_sched_handler(struct hrtimer *hrtimer)
+{
+	struct bcm_tx_sched *ts = container_of(hrtimer, struct bcm_tx_sched,
+					       timer);
+	unsigned long ticks;
+
+	ticks = hrtimer_forward(hrtimer, ktime_get(), ts->kt_tick);
+	ts->kt_due = ktime_sub(hrtimer_get_expires(hrtimer), ts->kt_tick);
+	atomic_add(ticks, &ts->pending);
+
+	tasklet_schedule(&ts->tsklet);
+
+	return HRTIMER_RESTART;
+}
+
+/*
+ * bcm_tx_sched_del - remove a tx op from its transmit scheduler
+ *                    (the scheduler is released with its last tx op)
+ */
+static void bcm_tx_sched_del(struct bcm_op *op)
+{
+	struct bcm_tx_sched *ts = op->sched;
+
+	spin_lock_bh(&ts->lock);
+	list_del(&op->sched_list);
+	ts->op_num--;
+	spin_unlock_bh(&ts->lock);
+
+	op->sched = NULL;
+
+	if (ts->op_num)
+		return;
+
+	hrtimer_cancel(&ts->timer);
+	tasklet_kill(&ts->tsklet);
+	list_del(&ts->list);
+
+	if (ts->dev)
+		dev_put(ts->dev);
+
+	skb_queue_purge(&ts->pool);
+	kfree(ts);
+}
+
+/*
+ * bcm_tx_sched_add - add a cyclic tx op to the transmit scheduler of its
+ *                    interface. Returns 1 when the tx op is scheduled and
+ *                    0 when it has to use its own timer.
+ */
+static int bcm_tx_sched_add(struct bcm_sock *bo, struct bcm_op *op)
+{
+	struct bcm_tx_sched *ts;
+	unsigned long ival, tick;
+	u32 pending;
+	s64 us;
+
+	/* only pure cyclic transmissions without a count phase */
+	if (!op->kt_ival2.tv64 || (op->kt_ival1.tv64 && op->count))
+		return 0;
+
+	us = ktime_to_us(op->kt_ival2);
+	if (us < BCM_TX_SCHED_MIN_TICK || us > BCM_TX_SCHED_MAX_IVAL)
+		return 0;
+
+	ival = us;
+
+	list_for_each_entry(ts, &bo->tx_scheds, list) {
+		if (ts->ifindex == op->ifindex)
+			break;
+	}
+
+	if (&ts->list == &bo->tx_scheds) {
+
+		/* no scheduler for this interface yet */
+		ts = kzalloc(sizeof(*ts), GFP_KERNEL);
+		if (!ts)
+			return 0;
+
+		INIT_LIST_HEAD(&ts->ops);
+		spin_lock_init(&ts->lock);
+		ts->ifindex = op->ifindex;
+		skb_queue_head_init(&ts->pool);
+
+		/* the device reference is dropped in bcm_notifier() */
+		if (ts->ifindex)
+			ts->dev = dev_get_by_index(&init_net, ts->ifindex);
+		ts->tick = ival;
+		ts->kt_tick = ktime_set(ival / 1000000,
+					(ival % 1000000) * 1000);
+		atomic_set(&ts->pending, 0);
+
+		hrtimer_init(&ts->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+		ts->timer.function = bcm_tx_sched_handler;
+
+		tasklet_init(&ts->tsklet, bcm_tx_sched_tsklet,
+			     (unsigned long) ts);
+
+		list_add_tail(&ts->list, &bo->tx_scheds);
+
+		op->sched_ticks = op->sched_cnt = 1;
+		list_add_tail(&op->sched_list, &ts->ops);
+		ts->op_num++;
+		op->sched = ts;
+
+		bcm_tx_sched_fill(ts, GFP_KERNEL);
+
+		ts->kt_due = ktime_get();
+		hrtimer_start(&ts->timer, ktime_add(ts->kt_due, ts->kt_tick),
+			      HRTIMER_MODE_ABS);
+		return 1;
+	}
+
+	tick = bcm_gcd(ts->tick, ival);
+
+	/* the interval is not harmonic to the other scheduled intervals */
+	if (tick < BCM_TX_SCHED_MIN_TICK)
+		return 0;
+
+	spin_lock_bh(&ts->lock);
+
+	if (tick != ts->tick) {
+		struct bcm_op *sop;
+		ktime_t next;
+		u32 factor;
+
+		/*
+		 * Subdivide the tick. The ticks that are still pending for
+		 * the tasklet and the next expiry keep the former tick.
+		 */
+		hrtimer_cancel(&ts->timer);
+		next = hrtimer_get_expires(&ts->timer);
+		pending = atomic_read(&ts->pending);
+
+		factor = ts->tick / tick;
+		list_for_each_entry(sop, &ts->ops, sched_list) {
+			sop->sched_ticks *= factor;
+			if (sop->sched_cnt > pending)
+				sop->sched_cnt = pending + 1 +
+					(sop->sched_cnt - pending - 1) * factor;
+		}
+
+		ts->tick = tick;
+		ts->kt_tick = ktime_set(tick / 1000000,
+					(tick % 1000000) * 1000);
+
+		hrtimer_start(&ts->timer, next, HRTIMER_MODE_ABS);
+	}
+
+	op->sched_ticks = ival / tick;
+	op->sched_cnt = op->sched_ticks + atomic_read(&ts->pending);
+	list_add_tail(&op->sched_list, &ts->ops);
+	ts->op_num++;
+	op->sched = ts;
+
+	spin_unlock_bh(&ts->lock);
+
+	bcm_tx_sched_fill(ts, GFP_KERNEL);
+
+	return 1;
+}
+
 /*
  * bcm_rx_changed - create a RX_CHANGED notification due to changed content
  */
@@ -530,6 +1114,10 @@ static void bcm_rx_changed(struct bcm_op *op, struct can_frame *data)
 	/* this element is not throttled anymore */
 	data->can_dlc &= (BCM_CAN_DLC_MASK|RX_RECV);
 
+	/* collect the change for the RX_DIGEST if enabled */
+	if (bcm_rx_digest_add(op, data))
+		return;
+
 	head.opcode  = RX_CHANGED;
 	head.flags   = op->flags;
 	head.count   = op->count;
@@ -753,6 +1341,60 @@ static enum hrtimer_restart bcm_rx_thr_handler(struct hrtimer *hrtimer)
 	}
 }
 
+/*
+ * bcm_rx_mux_disable - fall back to the linear search of the MUX frames
+ *
+ * Must be called before the frames of an existing rx op are changed.
+ */
+static void bcm_rx_mux_disable(struct bcm_op *op)
+{
+	op->mux_direct = 0;
+	smp_wmb();
+}
+
+/*
+ * bcm_rx_mux_setup - build the direct MUX index of a multiplex rx op
+ *
+ * When all bits of the MUX-mask (in index 0) are located in an 8 bit window
+ * the masked MUX value of a received frame directly selects the index of the
+ * first fitting frame (0 = no fitting frame). Other masks keep the linear
+ * search in bcm_rx_handler().
+ */
+static void bcm_rx_mux_setup(struct bcm_op *op)
+{
+	u64 mask;
+	unsigned int i, shift;
+
+	if (!op->mux_idx)
+		return;
+
+	/* fall back to the linear search while changing the index */
+	bcm_rx_mux_disable(op);
+
+	if (op->nframes < 2 || (op->flags & RX_FILTER_ID))
+		return;
+
+	mask = GET_U64(&op->frames[0]);
+	if (!mask)
+		return;
+
+	for (shift = 0; !(mask & (1ULL << shift)); shift++)
+		;
+
+	if ((mask >> shift) >= BCM_MUX_IDX_SIZE)
+		return;
+
+	memset(op->mux_idx, 0, BCM_MUX_IDX_SIZE * sizeof(*op->mux_idx));
+
+	/* fill backwards to let the first fitting frame win */
+	for (i = op->nframes - 1; i > 0; i--)
+		op->mux_idx[(mask & GET_U64(&op->frames[i])) >> shift] = i;
+
+	op->mux_shift = shift;
+	smp_wmb();
+	op->mux_direct = 1;
+}
+
 /*
  * bcm_rx_handler - handle a CAN frame receiption
  */
@@ -801,6 +1443,16 @@ static void bcm_rx_handler(struct sk_buff *skb, void *data)
 		 * Remark: The MUX-mask is stored in index 0
 		 */
 
+		if (op->mux_direct) {
+			/* see bcm_rx_mux_setup() */
+			smp_rmb();
+			i = op->mux_idx[(GET_U64(&op->frames[0]) &
+					 GET_U64(rxframe)) >> op->mux_shift];
+			if (i)
+				bcm_rx_cmp_to_index(op, i, rxframe);
+			goto rx_starttimer;
+		}
+
 		for (i = 1; i < op->nframes; i++) {
 			if ((GET_U64(&op->frames[0]) & GET_U64(rxframe)) ==
 			    (GET_U64(&op->frames[0]) &
@@ -818,12 +1470,79 @@ rx_starttimer:
 /*
  * helpers for bcm_op handling: find & delete bcm [rx|tx] op elements
  */
-static struct bcm_op *bcm_find_op(struct list_head *ops, canid_t can_id,
+static inline struct hlist_head *bcm_hash_head(struct bcm_hash *hash,
+					       canid_t can_id, int ifindex)
+{
+	return &hash->heads[jhash_2words(can_id, ifindex, 0) &
+			    ((1 << hash->bits) - 1)];
+}
+
+static void bcm_hash_init(struct bcm_hash *hash)
+{
+	int i;
+
+	hash->heads = hash->small;
+	hash->bits  = BCM_HASH_MIN_BITS;
+	hash->count = 0;
+
+	for (i = 0; i < (1 << BCM_HASH_MIN_BITS); i++)
+		INIT_HLIST_HEAD(&hash->small[i]);
+}
+
+static void bcm_hash_free(struct bcm_hash *hash)
+{
+	if (hash->heads != hash->small)
+		kfree(hash->heads);
+
+	hash->heads = hash->small;
+}
+
+/*
+ * bcm_hash_grow - double the number of hash buckets
+ *
+ * The hash is only used in process context with the socket lock held.
+ * When the allocation fails the ops just stay in the current table.
+ */
+static void bcm_hash_grow(struct bcm_hash *hash)
+{
+	struct hlist_head *old = hash->heads;
+	unsigned int oldsize = 1 << hash->bits;
+	struct hlist_head *heads;
+	struct hlist_node *n, *next;
+	struct bcm_op *op;
+	unsigned int i;
+
+	heads = kmalloc(2 * oldsize * sizeof(*heads), GFP_KERNEL);
+	if (!heads)
+		return;
+
+	for (i = 0; i < 2 * oldsize; i++)
+		INIT_HLIST_HEAD(&heads[i]);
+
+	hash->heads = heads;
+	hash->bits++;
+
+	for (i = 0; i < oldsize; i++) {
+		hlist_for_each_entry_safe(op, n, next, &old[i], hlist) {
+			hlist_del(&op->hlist);
+			hlist_add_head(&op->hlist,
+				       bcm_hash_head(hash, op->can_id,
+						     op->ifindex));
+		}
+	}
+
+	if (old != hash->small)
+		kfree(old);
+}
+
+static struct bcm_op *bcm_find_op(struct bcm_hash *hash, canid_t can_id,
 				  int ifindex)
 {
 	struct bcm_op *op;
+	struct hlist_node *n;
 
-	list_for_each_entry(op, ops, list) {
+	hlist_for_each_entry(op, n, bcm_hash_head(hash, can_id, ifindex),
+			     hlist) {
 		if ((op->can_id == can_id) && (op->ifindex == ifindex))
 			return op;
 	}
@@ -831,8 +1550,36 @@ static struct bcm_op *bcm_find_op(struct list_head *ops, canid_t can_id,
 	return NULL;
 }
 
+/* add the op to the ops list (for the dumps) and to the hash table */
+static void bcm_insert_op(struct bcm_op *op, struct list_head *ops,
+			  struct bcm_hash *hash)
+{
+	list_add(&op->list, ops);
+	hlist_add_head(&op->hlist, bcm_hash_head(hash, op->can_id,
+						 op->ifindex));
+
+	if (++hash->count > (1 << hash->bits) &&
+	    hash->bits < BCM_HASH_MAX_BITS)
+		bcm_hash_grow(hash);
+}
+
+/* unlink the op from the ops list and from the hash table */
+static void bcm_unlink_op(struct bcm_op *op, struct bcm_hash *hash)
+{
+	list_del(&op->list);
+	hlist_del(&op->hlist);
+	hash->count--;
+}
+
 static void bcm_remove_op(struct bcm_op *op)
 {
+	if (op->sched)
+		bcm_tx_sched_del(op);
+
+	/* only rx ops can be part of the RX_DIGEST */
+	if (op->last_frames)
+		bcm_rx_digest_purge(op);
+
 	hrtimer_cancel(&op->timer);
 	hrtimer_cancel(&op->thrtimer);
 
@@ -848,6 +1595,7 @@ static void bcm_remove_op(struct bcm_op *op)
 	if ((op->last_frames) && (op->last_frames != &op->last_sframe))
 		kfree(op->last_frames);
 
+	kfree(op->mux_idx);
 	kfree(op);
 
 	return;
@@ -869,73 +1617,65 @@ static void bcm_rx_unreg(struct net_device *dev, struct bcm_op *op)
 /*
  * bcm_delete_rx_op - find and remove a rx op (returns number of removed ops)
  */
-static int bcm_delete_rx_op(struct list_head *ops, canid_t can_id, int ifindex)
+static int bcm_delete_rx_op(struct bcm_hash *hash, canid_t can_id,
+			    int ifindex)
 {
-	struct bcm_op *op, *n;
+	struct bcm_op *op = bcm_find_op(hash, can_id, ifindex);
 
-	list_for_each_entry_safe(op, n, ops, list) {
-		if ((op->can_id == can_id) && (op->ifindex == ifindex)) {
+	if (!op)
+		return 0; /* not found */
 
-			/*
-			 * Don't care if we're bound or not (due to netdev
-			 * problems) can_rx_unregister() is always a save
-			 * thing to do here.
-			 */
-			if (op->ifindex) {
-				/*
-				 * Only remove subscriptions that had not
-				 * been removed due to NETDEV_UNREGISTER
-				 * in bcm_notifier()
-				 */
-				if (op->rx_reg_dev) {
-					struct net_device *dev;
-
-					dev = dev_get_by_index(&init_net,
-							       op->ifindex);
-					if (dev) {
-						bcm_rx_unreg(dev, op);
-						dev_put(dev);
-					}
-				}
-			} else
-				can_rx_unregister(NULL, op->can_id,
-						  REGMASK(op->can_id),
-						  bcm_rx_handler, op);
+	/*
+	 * Don't care if we're bound or not (due to netdev problems)
+	 * can_rx_unregister() is always a save thing to do here.
+	 */
+	if (op->ifindex) {
+		/*
+		 * Only remove subscriptions that had not
+		 * been removed due to NETDEV_UNREGISTER
+		 * in bcm_notifier()
+		 */
+		if (op->rx_reg_dev) {
+			struct net_device *dev;
 
-			list_del(&op->list);
-			bcm_remove_op(op);
-			return 1; /* done */
+			dev = dev_get_by_index(&init_net, op->ifindex);
+			if (dev) {
+				bcm_rx_unreg(dev, op);
+				dev_put(dev);
+			}
 		}
-	}
+	} else
+		can_rx_unregister(NULL, op->can_id, REGMASK(op->can_id),
+				  bcm_rx_handler, op);
 
-	return 0; /* not found */
+	bcm_unlink_op(op, hash);
+	bcm_remove_op(op);
+	return 1; /* done */
 }
 
 /*
  * bcm_delete_tx_op - find and remove a tx op (returns number of removed ops)
  */
-static int bcm_delete_tx_op(struct list_head *ops, canid_t can_id, int ifindex)
+static int bcm_delete_tx_op(struct bcm_hash *hash, canid_t can_id,
+			    int ifindex)
 {
-	struct bcm_op *op, *n;
+	struct bcm_op *op = bcm_find_op(hash, can_id, ifindex);
 
-	list_for_each_entry_safe(op, n, ops, list) {
-		if ((op->can_id == can_id) && (op->ifindex == ifindex)) {
-			list_del(&op->list);
-			bcm_remove_op(op);
-			return 1; /* done */
-		}
-	}
+	if (!op)
+		return 0; /* not found */
 
-	return 0; /* not found */
+	bcm_unlink_op(op, hash);
+	bcm_remove_op(op);
+	return 1; /* done */
 }
 
 /*
  * bcm_read_op - read out a bcm_op and send it to the user (for bcm_sendmsg)
  */
-static int bcm_read_op(struct list_head *ops, struct bcm_msg_head *msg_head,
+static int bcm_read_op(struct bcm_hash *hash, struct bcm_msg_head *msg_head,
 		       int ifindex)
 {
-	struct bcm_op *op = bcm_find_op(ops, msg_head->can_id, ifindex);
+	struct bcm_op *op = bcm_find_op(hash, msg_head->can_id, ifindex);
 
 	if (!op)
 		return -EINVAL;
@@ -972,7 +1712,7 @@ static int bcm_tx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 		return -EINVAL;
 
 	/* check the given can_id */
-	op = bcm_find_op(&bo->tx_ops, msg_head->can_id, ifindex);
+	op = bcm_find_op(&bo->tx_hash, msg_head->can_id, ifindex);
 
 	if (op) {
 		/* update existing BCM operation */
@@ -1061,9 +1801,9 @@ static int bcm_tx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 		hrtimer_init(&op->thrtimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 
 		/* add this bcm_op to the list of the tx_ops */
-		list_add(&op->list, &bo->tx_ops);
+		bcm_insert_op(op, &bo->tx_ops, &bo->tx_hash);
 
-	} /* if ((op = bcm_find_op(&bo->tx_ops, msg_head->can_id, ifindex))) */
+	} /* if ((op = bcm_find_op(&bo->tx_hash, msg_head->can_id, ifindex))) */
 
 	if (op->nframes != msg_head->nframes) {
 		op->nframes   = msg_head->nframes;
@@ -1091,10 +1831,20 @@ static int bcm_tx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 		/* disable an active timer due to zero values? */
 		if (!op->kt_ival1.tv64 && !op->kt_ival2.tv64)
 			hrtimer_cancel(&op->timer);
+
+		/* reschedule a running transmission with the new interval */
+		if (op->sched) {
+			bcm_tx_sched_del(op);
+			if (!(op->flags & STARTTIMER) &&
+			    !bcm_tx_sched_add(bo, op))
+				bcm_tx_start_timer(op);
+		}
 	}
 
 	if (op->flags & STARTTIMER) {
 		hrtimer_cancel(&op->timer);
+		if (op->sched)
+			bcm_tx_sched_del(op);
 		/* spec: send can_frame when starting timer */
 		op->flags |= TX_ANNOUNCE;
 	}
@@ -1105,7 +1855,8 @@ static int bcm_tx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 			op->count--;
 	}
 
-	if (op->flags & STARTTIMER)
+	/* cyclic transmissions share the transmit scheduler if possible */
+	if ((op->flags & STARTTIMER) && !bcm_tx_sched_add(bo, op))
 		bcm_tx_start_timer(op);
 
 	return msg_head->nframes * CFSIZ + MHSIZ;
@@ -1139,7 +1890,7 @@ static int bcm_rx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 		return -EINVAL;
 
 	/* check the given can_id */
-	op = bcm_find_op(&bo->rx_ops, msg_head->can_id, ifindex);
+	op = bcm_find_op(&bo->rx_hash, msg_head->can_id, ifindex);
 	if (op) {
 		/* update existing BCM operation */
 
@@ -1151,13 +1902,18 @@ static int bcm_rx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 		if (msg_head->nframes > op->nframes)
 			return -E2BIG;
 
+		/* the MUX index is rebuilt below for the new frames */
+		bcm_rx_mux_disable(op);
+
 		if (msg_head->nframes) {
 			/* update can_frames content */
 			err = memcpy_fromiovec((u8 *)op->frames,
 					       msg->msg_iov,
 					       msg_head->nframes * CFSIZ);
-			if (err < 0)
+			if (err < 0) {
+				bcm_rx_mux_setup(op);
 				return err;
+			}
 
 			/* clear last_frames to indicate 'nothing received' */
 			memset(op->last_frames, 0, msg_head->nframes * CFSIZ);
@@ -1195,6 +1951,11 @@ static int bcm_rx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 				return -ENOMEM;
 			}
 
+			/* without a MUX index the frames are scanned */
+			op->mux_idx = kmalloc(BCM_MUX_IDX_SIZE *
+					      sizeof(*op->mux_idx),
+					      GFP_KERNEL);
+
 		} else {
 			op->frames = &op->sframe;
 			op->last_frames = &op->last_sframe;
@@ -1208,6 +1969,7 @@ static int bcm_rx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 					kfree(op->frames);
 				if (op->last_frames != &op->last_sframe)
 					kfree(op->last_frames);
+				kfree(op->mux_idx);
 				kfree(op);
 				return err;
 			}
@@ -1233,16 +1995,19 @@ static int bcm_rx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 			     (unsigned long) op);
 
 		/* add this bcm_op to the list of the rx_ops */
-		list_add(&op->list, &bo->rx_ops);
+		bcm_insert_op(op, &bo->rx_ops, &bo->rx_hash);
 
 		/* call can_rx_register() */
 		do_rx_register = 1;
 
-	} /* if ((op = bcm_find_op(&bo->rx_ops, msg_head->can_id, ifindex))) */
+	} /* if ((op = bcm_find_op(&bo->rx_hash, msg_head->can_id, ifindex))) */
 
 	/* check flags */
 	op->flags = msg_head->flags;
 
+	/* (re)build the MUX index for the new frames content */
+	bcm_rx_mux_setup(op);
+
 	if (op->flags & RX_RTR_FRAME) {
 
 		/* no timers in RTR-mode */
@@ -1307,7 +2072,7 @@ static int bcm_rx_setup(struct bcm_msg_head *msg_head, struct msghdr *msg,
 					      bcm_rx_handler, op, "bcm");
 		if (err) {
 			/* this bcm rx op is broken -> remove it */
-			list_del(&op->list);
+			bcm_unlink_op(op, &bo->rx_hash);
 			bcm_remove_op(op);
 			return err;
 		}
@@ -1427,14 +2192,14 @@ static int bcm_sendmsg(struct kiocb *iocb, struct socket *sock,
 		break;
 
 	case TX_DELETE:
-		if (bcm_delete_tx_op(&bo->tx_ops, msg_head.can_id, ifindex))
+		if (bcm_delete_tx_op(&bo->tx_hash, msg_head.can_id, ifindex))
 			ret = MHSIZ;
 		else
 			ret = -EINVAL;
 		break;
 
 	case RX_DELETE:
-		if (bcm_delete_rx_op(&bo->rx_ops, msg_head.can_id, ifindex))
+		if (bcm_delete_rx_op(&bo->rx_hash, msg_head.can_id, ifindex))
 			ret = MHSIZ;
 		else
 			ret = -EINVAL;
@@ -1443,13 +2208,13 @@ static int bcm_sendmsg(struct kiocb *iocb, struct socket *sock,
 	case TX_READ:
 		/* reuse msg_head for the reply to TX_READ */
 		msg_head.opcode  = TX_STATUS;
-		ret = bcm_read_op(&bo->tx_ops, &msg_head, ifindex);
+		ret = bcm_read_op(&bo->tx_hash, &msg_head, ifindex);
 		break;
 
 	case RX_READ:
 		/* reuse msg_head for the reply to RX_READ */
 		msg_head.opcode  = RX_STATUS;
-		ret = bcm_read_op(&bo->rx_ops, &msg_head, ifindex);
+		ret = bcm_read_op(&bo->rx_hash, &msg_head, ifindex);
 		break;
 
 	case TX_SEND:
@@ -1480,6 +2245,8 @@ static int bcm_notifier(struct notifier_block *nb, unsigned long msg,
 	struct bcm_sock *bo = container_of(nb, struct bcm_sock, notifier);
 	struct sock *sk = &bo->sk;
 	struct bcm_op *op;
+	struct bcm_tx_sched *ts;
+	struct net_device *cached;
 	int notify_enodev = 0;
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
@@ -1503,6 +2270,18 @@ static int bcm_notifier(struct notifier_block *nb, unsigned long msg,
 			if (op->rx_reg_dev == dev)
 				bcm_rx_unreg(dev, op);
 
+		/* drop the cached device of the transmit schedulers */
+		list_for_each_entry(ts, &bo->tx_scheds, list) {
+			spin_lock_bh(&ts->lock);
+			cached = ts->dev;
+			if (cached == dev)
+				ts->dev = NULL;
+			spin_unlock_bh(&ts->lock);
+
+			if (cached == dev)
+				dev_put(dev);
+		}
+
 		/* remove device reference, if this is our bound device */
 		if (bo->bound && bo->ifindex == dev->ifindex) {
 			bo->bound   = 0;
@@ -1543,8 +2322,23 @@ static int bcm_init(struct sock *sk)
 	bo->bcm_proc_read    = NULL;
 
 	INIT_LIST_HEAD(&bo->tx_ops);
+	INIT_LIST_HEAD(&bo->tx_scheds);
 	INIT_LIST_HEAD(&bo->rx_ops);
 
+	bcm_hash_init(&bo->tx_hash);
+	bcm_hash_init(&bo->rx_hash);
+
+	/* RX_DIGEST is disabled by default */
+	spin_lock_init(&bo->digest_lock);
+	memset(&bo->digest_ival, 0, sizeof(bo->digest_ival));
+	bo->kt_digest  = ktime_set(0, 0);
+	bo->digest     = NULL;
+	bo->digest_cnt = 0;
+	hrtimer_init(&bo->digest_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	bo->digest_timer.function = bcm_rx_digest_handler;
+	tasklet_init(&bo->digest_tsklet, bcm_rx_digest_tsklet,
+		     (unsigned long) bo);
+
 	/* set notifier */
 	bo->notifier.notifier_call = bcm_notifier;
 
@@ -1604,6 +2398,15 @@ static int bcm_release(struct socket *sock)
 		bcm_remove_op(op);
 	}
 
+	bcm_hash_free(&bo->tx_hash);
+	bcm_hash_free(&bo->rx_hash);
+
+	/* all rx ops are gone => no more RX_DIGEST elements */
+	hrtimer_cancel(&bo->digest_timer);
+	tasklet_kill(&bo->digest_tsklet);
+	kfree(bo->digest);
+	bo->digest = NULL;
+
 	/* remove procfs entry */
 	if (proc_dir && bo->bcm_proc_read)
 		remove_proc_entry(bo->procname, proc_dir);
@@ -1676,6 +2479,116 @@ static int bcm_connect(struct socket *sock, struct sockaddr *uaddr, int len,
 	return 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,32)
+static int bcm_setsockopt(struct socket *sock, int level, int optname,
+			  char __user *optval, unsigned int optlen)
+#else
+static int bcm_setsockopt(struct socket *sock, int level, int optname,
+			  char __user *optval, int optlen)
+#endif
+{
+	struct sock *sk = sock->sk;
+	struct bcm_sock *bo = bcm_sk(sk);
+	struct bcm_digest_entry *digest = NULL;
+	struct timeval ival;
+
+	if (level != SOL_CAN_BCM)
+		return -EINVAL;
+
+	switch (optname) {
+
+	case CAN_BCM_RX_DIGEST:
+		if (optlen != sizeof(ival))
+			return -EINVAL;
+
+		if (copy_from_user(&ival, optval, optlen))
+			return -EFAULT;
+
+		if (ival.tv_sec < 0 || ival.tv_usec < 0 ||
+		    ival.tv_usec >= USEC_PER_SEC)
+			return -EINVAL;
+
+		if (ival.tv_sec || ival.tv_usec) {
+			digest = kmalloc(BCM_DIGEST_MAX * sizeof(*digest),
+					 GFP_KERNEL);
+			if (!digest)
+				return -ENOMEM;
+		}
+
+		lock_sock(sk);
+
+		spin_lock_bh(&bo->digest_lock);
+
+		/* send the changes collected so far with the former setting */
+		bcm_rx_digest_flush(bo);
+
+		bo->digest_ival = ival;
+		bo->kt_digest = timeval_to_ktime(ival);
+
+		/* keep an existing array, otherwise swap it */
+		if (!digest || !bo->digest) {
+			struct bcm_digest_entry *old = bo->digest;
+
+			bo->digest = digest;
+			digest = old;
+		}
+
+		spin_unlock_bh(&bo->digest_lock);
+
+		if (!bo->digest) {
+			/* disabled => no pending RX_DIGEST anymore */
+			hrtimer_cancel(&bo->digest_timer);
+			tasklet_kill(&bo->digest_tsklet);
+		}
+
+		release_sock(sk);
+
+		kfree(digest);
+		break;
+
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	return 0;
+}
+
+static int bcm_getsockopt(struct socket *sock, int level, int optname,
+			  char __user *optval, int __user *optlen)
+{
+	struct sock *sk = sock->sk;
+	struct bcm_sock *bo = bcm_sk(sk);
+	struct timeval ival;
+	int len;
+
+	if (level != SOL_CAN_BCM)
+		return -EINVAL;
+	if (get_user(len, optlen))
+		return -EFAULT;
+	if (len < 0)
+		return -EINVAL;
+
+	switch (optname) {
+
+	case CAN_BCM_RX_DIGEST:
+		if (len > sizeof(ival))
+			len = sizeof(ival);
+		spin_lock_bh(&bo->digest_lock);
+		ival = bo->digest_ival;
+		spin_unlock_bh(&bo->digest_lock);
+		break;
+
+	default:
+		return -ENOPROTOOPT;
+	}
+
+	if (put_user(len, optlen))
+		return -EFAULT;
+	if (copy_to_user(optval, &ival, len))
+		return -EFAULT;
+	return 0;
+}
+
 static int bcm_recvmsg(struct kiocb *iocb, struct socket *sock,
 		       struct msghdr *msg, size_t size, int flags)
 {
@@ -1724,8 +2637,8 @@ static const struct proto_ops bcm_ops = {
 	.ioctl         = can_ioctl,	/* use can_ioctl() from af_can.c */
 	.listen        = sock_no_listen,
 	.shutdown      = sock_no_shutdown,
-	.setsockopt    = sock_no_setsockopt,
-	.getsockopt    = sock_no_getsockopt,
+	.setsockopt    = bcm_setsockopt,
+	.getsockopt    = bcm_getsockopt,
 	.sendmsg       = bcm_sendmsg,
 	.recvmsg       = bcm_recvmsg,
 	.mmap          = sock_no_mmap,
@@ -53,8 +53,21 @@
 #include <linux/netdevice.h>
 #include <linux/if_arp.h>
 #include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/miscdevice.h>
+#include <linux/uaccess.h>
 #include <socketcan/can.h>
 #include <socketcan/can/core.h>
+#include <socketcan/can/raw.h>
 #include <socketcan/can/gw.h>
 #include <net/rtnetlink.h>
 #include <net/net_namespace.h>
@@ -72,7 +85,31 @@ MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("Oliver Hartkopp <oliver.hartkopp@volkswagen.de>");
 MODULE_ALIAS("can-gw");
 
+static unsigned int max_hops __read_mostly = 1;
+module_param(max_hops, uint, S_IRUGO);
+MODULE_PARM_DESC(max_hops,
+		 "maximum can-gw routing hops for CAN frames "
+		 "(valid values: " __stringify(CGW_MIN_HOPS) "-"
+		 __stringify(CGW_MAX_HOPS) " hops, "
+		 "default: 1)");
+
+/*
+ * The hop counter of a CAN frame is kept in skb->csum_start which is not
+ * used for CAN frames as they are always CHECKSUM_UNNECESSARY. It is zero
+ * for frames received from a CAN interface and incremented with each
+ * forwarding by a gateway job. skb_clone() and skb_copy() preserve it.
+ */
+#define cgw_hops(skb) ((skb)->csum_start)
+
 HLIST_HEAD(cgw_list);
+
+/*
+ * Hash table of all jobs indexed by (src, dst, filter) for a fast lookup on
+ * job removal. In opposite to cgw_list it is only accessed with RTNL held.
+ */
+#define CGW_HASH_BITS 8
+#define CGW_HASH_SIZE (1 << CGW_HASH_BITS)
+static struct hlist_head cgw_hash[CGW_HASH_SIZE];
 static struct notifier_block notifier;
 
 static struct kmem_cache *cgw_cache __read_mostly;
@@ -91,13 +128,29 @@ struct cf_mod {
 		u8 xor;
 		u8 set;
 	} modtype;
-	void (*modfunc[MAX_MODFUNCTIONS])(struct can_frame *cf,
-					  struct cf_mod *mod);
+
+	/*
+	 * The AND/OR/XOR/SET chain above fused into one AND and one XOR
+	 * operand for each CAN frame element (see cgw_fuse_mod()).
+	 * 'elems' contains the CGW_MOD_ID/DLC/DATA elements that are modified.
+	 */
+	struct {
+		struct can_frame and;
+		struct can_frame xor;
+		u8 elems;
+	} fused;
+
+	/* alive counter that is set into the CAN frame after modifications */
+	struct cgw_alive_cnt alive;
+
+	/* the frame is modified by the fused modifications or the counter */
+	u8 modified;
 
 	/* CAN frame checksum calculation after CAN frame modifications */
 	struct {
 		struct cgw_csum_xor xor;
 		struct cgw_csum_crc8 crc8;
+		struct cgw_csum_crc crc;
 	} csum;
 	struct {
 		void (*xor)(struct can_frame *cf, struct cgw_csum_xor *xor);
@@ -107,31 +160,117 @@ struct cf_mod {
 
 
 /*
- * So far we just support CAN -> CAN routing and frame modifications.
+ * Lookup tables for the slicing-by-4 CRC16/CRC32 calculation. CAN frames
+ * contain up to 8 bytes which are processed in two steps with 4 KByte of
+ * tables. The tables only depend on the CRC polynomial and are shared by
+ * all jobs using the same CRC algorithm (protected by RTNL).
+ */
+struct cgw_crc_tab {
+	struct list_head list;
+	struct rcu_head rcu;
+	int refcnt;
+	u32 poly;
+	u8 width;
+	u8 refl;
+	u32 t[4][256];
+};
+
+static LIST_HEAD(cgw_crc_tabs);
+
+/* per CAN ID state for the deduplication (see cgw_limit_frame()) */
+#define CGW_LIM_SLOTS 256
+
+struct cgw_lim_entry {
+	s64 tstamp;
+	canid_t can_id;
+	u8 used;
+	u8 can_dlc;
+	u8 data[8];
+};
+
+/* runtime data of the CGW_LIMIT rate limit & deduplication stage */
+struct cgw_lim {
+	spinlock_t lock;
+	s64 interval;
+	s64 cost;
+	s64 credit;
+	s64 credit_max;
+	s64 last;
+	u8 flags;
+	struct cgw_lim_entry *tab;
+};
+
+/*
+ * per CPU statistics of a gateway job - updated without locks from the
+ * receive path on the CPU that processes the frame, summed up on dump.
+ */
+struct cgw_stats {
+	u64 handled;
+	u64 dropped;
+	u64 suppressed;
+	u64 deleted;
+	u64 lat_hist[CGW_LAT_BUCKETS];
+};
+
+/*
+ * mmap'able ring of a CGW_RING_DEV file for CGW_TYPE_CAN_RING jobs
+ *
+ * The rings are linked into cgw_rings with RTNL held. The ring content and
+ * head are protected by the ring lock as the ring may be filled by several
+ * gateway jobs on different CPUs.
+ */
+struct cgw_ring {
+	struct list_head list;
+	u32 id;
+	spinlock_t lock;
+	struct can_raw_ring_slot *slots;
+	unsigned int slot_nr;
+	unsigned int head;
+	unsigned int drops;
+	wait_queue_head_t wait;
+};
+
+static LIST_HEAD(cgw_rings);
+static u32 cgw_ring_id;
+
+/*
+ * So far we support CAN -> CAN routing and CAN -> userspace ring delivery
+ * with frame modifications.
  *
  * The internal can_can_gw structure contains data and attributes for
- * a CAN -> CAN gateway job.
+ * a CAN -> CAN gateway job. It is also used for CAN -> ring jobs which
+ * have no destination interfaces (dst_num = 0) but a ring_id instead.
  */
 struct can_can_gw {
 	struct can_filter filter;
 	int src_idx;
-	int dst_idx;
+	int dst_idx[CGW_DST_MAX];
+	int dst_num;
+	u32 ring_id;
 };
 
 /* list entry for CAN gateways jobs */
 struct cgw_job {
 	struct hlist_node list;
+	struct hlist_node hlist;
 	struct rcu_head rcu;
-	u32 handled_frames;
-	u32 dropped_frames;
+	struct cgw_stats *stats;
 	struct cf_mod mod;
+	struct cgw_limit limit;
+	struct cgw_lim *lim;
+	u8 limit_hops;
+	struct cgw_crc_tab *crc_tab;
+	u32 crc_init;
+	atomic_t alive_cnt;
 	union {
 		/* CAN frame data source */
 		struct net_device *dev;
 	} src;
 	union {
-		/* CAN frame data destination */
-		struct net_device *dev;
+		/* CAN frame data destination(s) - ccgw.dst_num entries */
+		struct net_device *dev[CGW_DST_MAX];
+		/* userspace ring for CGW_TYPE_CAN_RING */
+		struct cgw_ring *ring;
 	} dst;
 	union {
 		struct can_can_gw ccgw;
@@ -141,23 +280,78 @@ struct cgw_job {
 	u16 flags;
 };
 
-/* modification functions that are invoked in the hot path in can_can_gw_rcv */
+/*
+ * Each bit of a CAN frame element that runs through a chain of AND, OR, XOR
+ * and SET operations finally gets kept, cleared, set or inverted. This can
+ * always be expressed as (val & and) ^ xor - so the entire chain of a job is
+ * precompiled into one AND/XOR operand pair for each element of the CAN frame
+ * and applied in a single pass in can_can_gw_rcv() without indirect calls.
+ */
+static inline void cgw_fuse_op(u64 *and, u64 *xor, int op, u64 val)
+{
+	switch (op) {
+
+	case CGW_MOD_AND:
+		*and &= val;
+		*xor &= val;
+		break;
+
+	case CGW_MOD_OR:
+		*and &= ~val;
+		*xor |= val;
+		break;
+
+	case CGW_MOD_XOR:
+		*xor ^= val;
+		break;
+
+	case CGW_MOD_SET:
+		*and = 0;
+		*xor = val;
+		break;
+	}
+}
+
+static void cgw_fuse_mod(struct cf_mod *mod, int op, struct can_frame *cf,
+			 u8 modtype)
+{
+	struct can_frame *fand = &mod->fused.and;
+	struct can_frame *fxor = &mod->fused.xor;
+	u64 and, xor;
+
+	if (modtype & CGW_MOD_ID) {
+		and = fand->can_id;
+		xor = fxor->can_id;
+		cgw_fuse_op(&and, &xor, op, cf->can_id);
+		fand->can_id = and;
+		fxor->can_id = xor;
+	}
+
+	if (modtype & CGW_MOD_DLC) {
+		and = fand->can_dlc;
+		xor = fxor->can_dlc;
+		cgw_fuse_op(&and, &xor, op, cf->can_dlc);
+		fand->can_dlc = and;
+		fxor->can_dlc = xor;
+	}
 
-#define MODFUNC(func, op) static void func(struct can_frame *cf, \
-					   struct cf_mod *mod) { op ; }
+	if (modtype & CGW_MOD_DATA)
+		cgw_fuse_op((u64 *)fand->data, (u64 *)fxor->data, op,
+			    *(u64 *)cf->data);
 
-MODFUNC(mod_and_id, cf->can_id &= mod->modframe.and.can_id)
-MODFUNC(mod_and_dlc, cf->can_dlc &= mod->modframe.and.can_dlc)
-MODFUNC(mod_and_data, *(u64 *)cf->data &= *(u64 *)mod->modframe.and.data)
-MODFUNC(mod_or_id, cf->can_id |= mod->modframe.or.can_id)
-MODFUNC(mod_or_dlc, cf->can_dlc |= mod->modframe.or.can_dlc)
-MODFUNC(mod_or_data, *(u64 *)cf->data |= *(u64 *)mod->modframe.or.data)
-MODFUNC(mod_xor_id, cf->can_id ^= mod->modframe.xor.can_id)
-MODFUNC(mod_xor_dlc, cf->can_dlc ^= mod->modframe.xor.can_dlc)
-MODFUNC(mod_xor_data, *(u64 *)cf->data ^= *(u64 *)mod->modframe.xor.data)
-MODFUNC(mod_set_id, cf->can_id = mod->modframe.set.can_id)
-MODFUNC(mod_set_dlc, cf->can_dlc = mod->modframe.set.can_dlc)
-MODFUNC(mod_set_data, *(u64 *)cf->data = *(u64 *)mod->modframe.set.data)
+	mod->fused.elems |= modtype & (CGW_MOD_ID | CGW_MOD_DLC | CGW_MOD_DATA);
+}
+
+/* apply the fused modifications in the hot path in can_can_gw_rcv() */
+static inline void cgw_apply_mod(struct can_frame *cf, struct cf_mod *mod)
+{
+	cf->can_id = (cf->can_id & mod->fused.and.can_id) ^
+		mod->fused.xor.can_id;
+	cf->can_dlc = (cf->can_dlc & mod->fused.and.can_dlc) ^
+		mod->fused.xor.can_dlc;
+	*(u64 *)cf->data = (*(u64 *)cf->data & *(u64 *)mod->fused.and.data) ^
+		*(u64 *)mod->fused.xor.data;
+}
 
 static inline void canframecpy(struct can_frame *dst, struct can_frame *src)
 {
@@ -336,20 +530,382 @@ static void cgw_csum_crc8_neg(struct can_frame *cf, struct cgw_csum_crc8 *crc8)
 	cf->data[crc8->result_idx] = crc^crc8->final_xor_val;
 }
 
+static inline unsigned int cgw_lim_hash(canid_t can_id)
+{
+	can_id ^= can_id >> 16;
+	can_id ^= can_id >> 8;
+
+	return can_id & (CGW_LIM_SLOTS - 1);
+}
+
+/*
+ * Check the received frame against the per CAN ID deduplication and the
+ * token bucket of the job. Returns 1 when the frame has to be suppressed.
+ *
+ * The table is indexed by a CAN ID hash without collision handling. An entry
+ * that is taken over by another CAN ID just lets pass one more frame.
+ */
+static int cgw_limit_frame(struct cgw_lim *lim, struct can_frame *cf)
+{
+	struct cgw_lim_entry *e = NULL;
+	s64 now = ktime_to_ns(ktime_get());
+	s64 credit;
+	int ret = 1;
+
+	spin_lock(&lim->lock);
+
+	if (lim->tab) {
+		e = &lim->tab[cgw_lim_hash(cf->can_id)];
+
+		if (e->used && e->can_id == cf->can_id &&
+		    !((lim->flags & CGW_LIMIT_ON_CHANGE) &&
+		      (e->can_dlc != cf->can_dlc ||
+		       memcmp(e->data, cf->data, cf->can_dlc))) &&
+		    !(lim->interval && now - e->tstamp >= lim->interval))
+			goto out;
+	}
+
+	if (lim->cost) {
+		credit = lim->credit + now - lim->last;
+		lim->last = now;
+
+		if (credit > lim->credit_max)
+			credit = lim->credit_max;
+
+		if (credit < lim->cost) {
+			lim->credit = credit;
+			goto out;
+		}
+
+		lim->credit = credit - lim->cost;
+	}
+
+	/* only remember the frames that are really forwarded */
+	if (e) {
+		e->used = 1;
+		e->can_id = cf->can_id;
+		e->can_dlc = cf->can_dlc;
+		memcpy(e->data, cf->data, cf->can_dlc);
+		e->tstamp = now;
+	}
+
+	ret = 0;
+out:
+	spin_unlock(&lim->lock);
+
+	return ret;
+}
+
+static struct cgw_lim *cgw_alloc_lim(struct cgw_limit *limit)
+{
+	struct cgw_lim *lim;
+
+	lim = kzalloc(sizeof(*lim), GFP_KERNEL);
+	if (!lim)
+		return NULL;
+
+	if (limit->interval || limit->flags & CGW_LIMIT_ON_CHANGE) {
+		lim->tab = kcalloc(CGW_LIM_SLOTS, sizeof(*lim->tab),
+				   GFP_KERNEL);
+		if (!lim->tab) {
+			kfree(lim);
+			return NULL;
+		}
+	}
+
+	spin_lock_init(&lim->lock);
+	lim->interval = (s64)limit->interval * NSEC_PER_MSEC;
+	lim->flags = limit->flags;
+
+	/* token bucket with a credit in ns that starts with a full burst */
+	if (limit->rate) {
+		lim->cost = NSEC_PER_SEC / limit->rate;
+		lim->credit_max = lim->cost * limit->burst;
+		lim->credit = lim->credit_max;
+		lim->last = ktime_to_ns(ktime_get());
+	}
+
+	return lim;
+}
+
+static struct hlist_head *cgw_hash_head(struct can_can_gw *ccgw)
+{
+	u32 key[4];
+
+	key[0] = ccgw->src_idx;
+	key[1] = ccgw->dst_idx[0] ^ ccgw->ring_id;
+	key[2] = ccgw->filter.can_id;
+	key[3] = ccgw->filter.can_mask;
+
+	return &cgw_hash[jhash2(key, 4, 0) & (CGW_HASH_SIZE - 1)];
+}
+
+static void cgw_free_crc_tab_rcu(struct rcu_head *rcu_head)
+{
+	kfree(container_of(rcu_head, struct cgw_crc_tab, rcu));
+}
+
+static void cgw_put_crc_tab(struct cgw_crc_tab *tab)
+{
+	ASSERT_RTNL();
+
+	if (--tab->refcnt)
+		return;
+
+	/* can_can_gw_rcv() of a deleted job may still use the table */
+	list_del(&tab->list);
+	call_rcu(&tab->rcu, cgw_free_crc_tab_rcu);
+}
+
+/* free the job and its resources - the crc_tab is put by the caller */
+static void cgw_free_job(struct cgw_job *gwj)
+{
+	if (gwj->lim) {
+		kfree(gwj->lim->tab);
+		kfree(gwj->lim);
+	}
+
+	if (gwj->stats)
+		free_percpu(gwj->stats);
+
+	kmem_cache_free(cgw_cache, gwj);
+}
+
+static void cgw_free_job_rcu(struct rcu_head *rcu_head)
+{
+	cgw_free_job(container_of(rcu_head, struct cgw_job, rcu));
+}
+
+/* count the latency from the reception of the frame into the histogram */
+static void cgw_count_latency(struct cgw_stats *stats, struct sk_buff *skb)
+{
+	s64 us;
+	int idx = 0;
+
+	/* no timestamp when net_enable_timestamp() came too late */
+	if (!skb->tstamp.tv64)
+		return;
+
+	us = ktime_to_us(ktime_sub(ktime_get_real(), skb->tstamp));
+	if (us > 0)
+		idx = fls(us > INT_MAX ? INT_MAX : (int)us);
+
+	if (idx >= CGW_LAT_BUCKETS)
+		idx = CGW_LAT_BUCKETS - 1;
+
+	stats->lat_hist[idx]++;
+}
+
+static u32 cgw_reflect(u32 val, int bits)
+{
+	u32 res = 0;
+	int i;
+
+	for (i = 0; i < bits; i++, val >>= 1)
+		res = (res << 1) | (val & 1);
+
+	return res;
+}
+
+/*
+ * The CRC register is kept in 32 bit: For the reflected algorithm the CRC
+ * is located in the lower bits and otherwise it is aligned to the MSB.
+ * This allows to use the same slicing-by-4 code for CRC16 and CRC32.
+ */
+static void cgw_init_crc_tab(struct cgw_crc_tab *tab)
+{
+	u32 crc, poly;
+	int i, j, k;
+
+	if (tab->refl) {
+		poly = cgw_reflect(tab->poly, tab->width);
+		for (i = 0; i < 256; i++) {
+			crc = i;
+			for (j = 0; j < 8; j++)
+				crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+			tab->t[0][i] = crc;
+		}
+	} else {
+		poly = tab->poly << (32 - tab->width);
+		for (i = 0; i < 256; i++) {
+			crc = (u32)i << 24;
+			for (j = 0; j < 8; j++)
+				crc = (crc & 0x80000000) ?
+					(crc << 1) ^ poly : crc << 1;
+			tab->t[0][i] = crc;
+		}
+	}
+
+	/* t[k][i] is the CRC of byte i followed by k zero bytes */
+	for (k = 1; k < 4; k++) {
+		for (i = 0; i < 256; i++) {
+			crc = tab->t[k - 1][i];
+			if (tab->refl)
+				crc = (crc >> 8) ^ tab->t[0][crc & 0xFF];
+			else
+				crc = (crc << 8) ^ tab->t[0][crc >> 24];
+			tab->t[k][i] = crc;
+		}
+	}
+}
+
+static struct cgw_crc_tab *cgw_get_crc_tab(u32 poly, u8 width, u8 refl)
+{
+	struct cgw_crc_tab *tab;
+
+	ASSERT_RTNL();
+
+	list_for_each_entry(tab, &cgw_crc_tabs, list) {
+		if (tab->poly == poly && tab->width == width &&
+		    tab->refl == refl) {
+			tab->refcnt++;
+			return tab;
+		}
+	}
+
+	tab = kmalloc(sizeof(*tab), GFP_KERNEL);
+	if (!tab)
+		return NULL;
+
+	tab->refcnt = 1;
+	tab->poly = poly;
+	tab->width = width;
+	tab->refl = refl;
+	cgw_init_crc_tab(tab);
+	list_add(&tab->list, &cgw_crc_tabs);
+
+	return tab;
+}
+
+static u32 cgw_crc_update(struct cgw_crc_tab *tab, u32 crc, u8 *p, int len)
+{
+	u32 (*t)[256] = tab->t;
+
+	if (tab->refl) {
+		for (; len >= 4; len -= 4, p += 4) {
+			crc ^= p[0] | p[1] << 8 | p[2] << 16 | (u32)p[3] << 24;
+			crc = t[3][crc & 0xFF] ^ t[2][(crc >> 8) & 0xFF] ^
+				t[1][(crc >> 16) & 0xFF] ^ t[0][crc >> 24];
+		}
+		while (len--)
+			crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+	} else {
+		for (; len >= 4; len -= 4, p += 4) {
+			crc ^= (u32)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+			crc = t[3][crc >> 24] ^ t[2][(crc >> 16) & 0xFF] ^
+				t[1][(crc >> 8) & 0xFF] ^ t[0][crc & 0xFF];
+		}
+		while (len--)
+			crc = (crc << 8) ^ t[0][(crc >> 24) ^ *p++];
+	}
+
+	return crc;
+}
+
+static void cgw_csum_crc(struct can_frame *cf, struct cgw_csum_crc *c,
+			 struct cgw_crc_tab *tab, u32 crc)
+{
+	int from = calc_idx(c->from_idx, cf->can_dlc);
+	int to = calc_idx(c->to_idx, cf->can_dlc);
+	int res = calc_idx(c->result_idx, cf->can_dlc);
+	int len = c->width / 8;
+	u8 id[4];
+	int i;
+
+	if (from < 0 || to < from || res < 0 || res + len > 8)
+		return;
+
+	crc = cgw_crc_update(tab, crc, &cf->data[from], to - from + 1);
+
+	if (c->data_id_len) {
+		for (i = 0; i < c->data_id_len; i++)
+			id[i] = c->data_id >> (i * 8);
+		crc = cgw_crc_update(tab, crc, id, c->data_id_len);
+	}
+
+	if (!tab->refl)
+		crc >>= 32 - tab->width;
+
+	crc ^= c->final_xor_val;
+
+	for (i = 0; i < len; i++) {
+		if (c->flags & CGW_CRC_RESULT_BE)
+			cf->data[res + len - 1 - i] = crc >> (i * 8);
+		else
+			cf->data[res + i] = crc >> (i * 8);
+	}
+}
+
+static void cgw_set_alive_cnt(struct can_frame *cf, struct cgw_alive_cnt *a,
+			      atomic_t *cnt)
+{
+	int idx = calc_idx(a->idx, cf->can_dlc);
+	int old, val;
+
+	if (idx < 0)
+		return;
+
+	/* take the next counter value also with concurrent receivers */
+	do {
+		old = atomic_read(cnt);
+		val = (old >= a->max_val) ? 0 : old + 1;
+	} while (atomic_cmpxchg(cnt, old, val) != old);
+
+	cf->data[idx] = (cf->data[idx] & ~a->mask) |
+		((val << (ffs(a->mask) - 1)) & a->mask);
+}
+
 /* the receive & process & send function */
+/* apply the modifications, the alive counter and the checksums in order */
+static void cgw_process_frame(struct cgw_job *gwj, struct can_frame *cf)
+{
+	cgw_apply_mod(cf, &gwj->mod);
+
+	if (gwj->mod.alive.mask)
+		cgw_set_alive_cnt(cf, &gwj->mod.alive, &gwj->alive_cnt);
+
+	if (gwj->mod.csumfunc.crc8)
+		(*gwj->mod.csumfunc.crc8)(cf, &gwj->mod.csum.crc8);
+
+	if (gwj->crc_tab)
+		cgw_csum_crc(cf, &gwj->mod.csum.crc, gwj->crc_tab,
+			     gwj->crc_init);
+
+	if (gwj->mod.csumfunc.xor)
+		(*gwj->mod.csumfunc.xor)(cf, &gwj->mod.csum.xor);
+}
+
 static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 {
 	struct cgw_job *gwj = (struct cgw_job *)data;
+	struct cgw_stats *stats = per_cpu_ptr(gwj->stats, smp_processor_id());
+	int last = gwj->ccgw.dst_num - 1;
 	struct can_frame *cf;
-	struct sk_buff *nskb;
-	int modidx = 0;
+	struct sk_buff *nskb, *tskb;
+	struct sk_buff_head queue;
+	struct net_device *dev;
+	int fwd, queued, sent;
+	int i;
 
-	/* do not handle already routed frames - see comment below */
-	if (skb_mac_header_was_set(skb))
+	/*
+	 * Do not handle CAN frames routed more than 'max_hops' times.
+	 * This delimiter protects against circular CAN routes.
+	 */
+	if (cgw_hops(skb) >= max_hops) {
+		stats->deleted++;
 		return;
+	}
 
-	if (!(gwj->dst.dev->flags & IFF_UP)) {
-		gwj->dropped_frames++;
+	/* rate limit & deduplication before any further processing */
+	if (gwj->lim &&
+	    cgw_limit_frame(gwj->lim, (struct can_frame *)skb->data)) {
+		stats->suppressed++;
+		return;
+	}
+
+	/* no need to process the frame for a single destination that's down */
+	if (!last && !(gwj->dst.dev[0]->flags & IFF_UP)) {
+		stats->dropped++;
 		return;
 	}
 
@@ -359,65 +915,232 @@ static void can_can_gw_rcv(struct sk_buff *skb, void *data)
 	 * When there is at least one modification function activated,
 	 * we need to copy the skb as we want to modify skb->data.
 	 */
-	if (gwj->mod.modfunc[0])
+	if (gwj->mod.modified)
 		nskb = skb_copy(skb, GFP_ATOMIC);
 	else
 		nskb = skb_clone(skb, GFP_ATOMIC);
 
 	if (!nskb) {
-		gwj->dropped_frames++;
+		stats->dropped += gwj->ccgw.dst_num;
 		return;
 	}
 
-	/*
-	 * Mark routed frames by setting some mac header length which is
-	 * not relevant for the CAN frames located in the skb->data section.
-	 *
-	 * As dev->header_ops is not set in CAN netdevices no one is ever
-	 * accessing the various header offsets in the CAN skbuffs anyway.
-	 * E.g. using the packet socket to read CAN frames is still working.
-	 */
-	skb_set_mac_header(nskb, 8);
-	nskb->dev = gwj->dst.dev;
+	/* put the incremented hop counter into the routed frame */
+	cgw_hops(nskb) = cgw_hops(skb) + 1;
+
+	/* first routing of this CAN frame -> apply the job's hop limit */
+	if (gwj->limit_hops && cgw_hops(nskb) == 1)
+		cgw_hops(nskb) = max_hops - gwj->limit_hops + 1;
 
 	/* pointer to modifiable CAN frame */
 	cf = (struct can_frame *)nskb->data;
 
-	/* perform preprocessed modification functions if there are any */
-	while (modidx < MAX_MODFUNCTIONS && gwj->mod.modfunc[modidx])
-		(*gwj->mod.modfunc[modidx++])(cf, &gwj->mod);
+	/* perform the fused modifications and checksum updates if needed */
+	if (gwj->mod.modified)
+		cgw_process_frame(gwj, cf);
+
+	/* account the forwarding latency based on the rx timestamp */
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		cgw_count_latency(stats, skb);
+
+	/* clear the skb timestamp if not configured the other way */
+	if (!(gwj->flags & CGW_FLAGS_CAN_SRC_TSTAMP))
+		nskb->tstamp.tv64 = 0;
+
+	/*
+	 * Unmodified frames without local echo have already been checked by
+	 * can_rcv() and are forwarded as one batch without the loopback
+	 * handling of can_send().
+	 */
+	fwd = !gwj->mod.modified && !(gwj->flags & CGW_FLAGS_CAN_ECHO);
+	if (fwd)
+		skb_queue_head_init(&queue);
+
+	/*
+	 * The frame has been matched and modified only once. Every additional
+	 * destination gets a clone that shares the (unmodified) data section
+	 * and the last destination consumes the processed skb itself.
+	 */
+	for (i = 0; i <= last; i++) {
+
+		dev = gwj->dst.dev[i];
+
+		if (!(dev->flags & IFF_UP)) {
+			stats->dropped++;
+			continue;
+		}
+
+		if (i == last) {
+			tskb = nskb;
+			nskb = NULL;
+		} else {
+			tskb = skb_clone(nskb, GFP_ATOMIC);
+			if (!tskb) {
+				stats->dropped++;
+				continue;
+			}
+		}
+
+		tskb->dev = dev;
+
+		if (fwd) {
+			__skb_queue_tail(&queue, tskb);
+			continue;
+		}
+
+		/* send to netdevice */
+		if (can_send(tskb, gwj->flags & CGW_FLAGS_CAN_ECHO))
+			stats->dropped++;
+		else
+			stats->handled++;
+	}
+
+	if (fwd) {
+		queued = skb_queue_len(&queue);
+		sent = can_send_fwd(&queue);
+		stats->handled += sent;
+		stats->dropped += queued - sent;
+	}
+
+	/* the last destination was down */
+	if (nskb)
+		kfree_skb(nskb);
+}
+
+/*
+ * can_ring_gw_rcv - put the (modified) CAN frame into the userspace ring
+ *
+ * The frame is processed on a copy on the stack as it is not forwarded
+ * to any netdevice. When the ring is full the frame is dropped and the
+ * drop is reported to the user in the next filled slot.
+ */
+static void can_ring_gw_rcv(struct sk_buff *skb, void *data)
+{
+	struct cgw_job *gwj = (struct cgw_job *)data;
+	struct cgw_stats *stats = per_cpu_ptr(gwj->stats, smp_processor_id());
+	struct cgw_ring *ring = gwj->dst.ring;
+	struct can_raw_ring_slot *slot;
+	struct can_frame cf;
+	struct timeval tv;
+
+	/* hop limit for routed frames - see can_can_gw_rcv() */
+	if (cgw_hops(skb) >= max_hops) {
+		stats->deleted++;
+		return;
+	}
+
+	/* rate limit & deduplication before any further processing */
+	if (gwj->lim &&
+	    cgw_limit_frame(gwj->lim, (struct can_frame *)skb->data)) {
+		stats->suppressed++;
+		return;
+	}
 
-	/* check for checksum updates when the CAN frame has been modified */
-	if (modidx) {
-		if (gwj->mod.csumfunc.crc8)
-			(*gwj->mod.csumfunc.crc8)(cf, &gwj->mod.csum.crc8);
+	memcpy(&cf, skb->data, sizeof(cf));
+
+	if (gwj->mod.modified)
+		cgw_process_frame(gwj, &cf);
+
+	/* account the forwarding latency based on the rx timestamp */
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		cgw_count_latency(stats, skb);
+
+	skb_get_timestamp(skb, &tv);
+	if (!tv.tv_sec && !tv.tv_usec)
+		do_gettimeofday(&tv);
+
+	spin_lock(&ring->lock);
+
+	slot = &ring->slots[ring->head];
+
+	if (slot->status != CAN_RAW_SLOT_KERNEL) {
+		/* ring is full */
+		ring->drops++;
+		spin_unlock(&ring->lock);
+		stats->dropped++;
+		return;
+	}
+
+	/* read the slot status before writing the slot content */
+	smp_rmb();
+
+	slot->drops      = ring->drops;
+	slot->bf.tv_sec  = tv.tv_sec;
+	slot->bf.tv_usec = tv.tv_usec;
+	slot->bf.ifindex = skb->dev->ifindex;
+	slot->bf.flags   = 0;
+	memcpy(&slot->bf.frame, &cf, sizeof(cf));
+
+	/* hand over the completely filled slot to the user */
+	smp_wmb();
+	slot->status = CAN_RAW_SLOT_USER;
+
+	if (++ring->head >= ring->slot_nr)
+		ring->head = 0;
+
+	spin_unlock(&ring->lock);
+
+	if (waitqueue_active(&ring->wait))
+		wake_up_interruptible(&ring->wait);
+
+	stats->handled++;
+}
+
+static inline int cgw_register_filter(struct cgw_job *gwj)
+{
+	void (*func)(struct sk_buff *, void *) = can_can_gw_rcv;
+
+	if (gwj->gwtype == CGW_TYPE_CAN_RING)
+		func = can_ring_gw_rcv;
+
+	return can_rx_register(gwj->src.dev, gwj->ccgw.filter.can_id,
+			       gwj->ccgw.filter.can_mask, func, gwj, "gw");
+}
+
+static inline void cgw_unregister_filter(struct cgw_job *gwj)
+{
+	void (*func)(struct sk_buff *, void *) = can_can_gw_rcv;
+
+	if (gwj->gwtype == CGW_TYPE_CAN_RING)
+		func = can_ring_gw_rcv;
+
+	can_rx_unregister(gwj->src.dev, gwj->ccgw.filter.can_id,
+			  gwj->ccgw.filter.can_mask, func, gwj);
+}
+
+/*
+ * unlink the job from cgw_list and the hash table and free it (RTNL held)
+ *
+ * can_can_gw_rcv(), can_ring_gw_rcv() and cgw_dump_jobs() may still use
+ * the job under rcu_read_lock() => free it after a grace period.
+ */
+static void cgw_delete_job(struct cgw_job *gwj)
+{
+	hlist_del_rcu(&gwj->list);
+	hlist_del_rcu(&gwj->hlist);
+	cgw_unregister_filter(gwj);
 
-		if (gwj->mod.csumfunc.xor)
-			(*gwj->mod.csumfunc.xor)(cf, &gwj->mod.csum.xor);
-	}
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		net_disable_timestamp();
 
-	/* clear the skb timestamp if not configured the other way */
-	if (!(gwj->flags & CGW_FLAGS_CAN_SRC_TSTAMP))
-		nskb->tstamp.tv64 = 0;
+	if (gwj->crc_tab)
+		cgw_put_crc_tab(gwj->crc_tab);
 
-	/* send to netdevice */
-	if (can_send(nskb, gwj->flags & CGW_FLAGS_CAN_ECHO))
-		gwj->dropped_frames++;
-	else
-		gwj->handled_frames++;
+	call_rcu(&gwj->rcu, cgw_free_job_rcu);
 }
 
-static inline int cgw_register_filter(struct cgw_job *gwj)
+static int cgw_job_uses_dev(struct cgw_job *gwj, struct net_device *dev)
 {
-	return can_rx_register(gwj->src.dev, gwj->ccgw.filter.can_id,
-			       gwj->ccgw.filter.can_mask, can_can_gw_rcv,
-			       gwj, "gw");
-}
+	int i;
 
-static inline void cgw_unregister_filter(struct cgw_job *gwj)
-{
-	can_rx_unregister(gwj->src.dev, gwj->ccgw.filter.can_id,
-			  gwj->ccgw.filter.can_mask, can_can_gw_rcv, gwj);
+	if (gwj->src.dev == dev)
+		return 1;
+
+	for (i = 0; i < gwj->ccgw.dst_num; i++)
+		if (gwj->dst.dev[i] == dev)
+			return 1;
+
+	return 0;
 }
 
 static int cgw_notifier(struct notifier_block *nb,
@@ -444,20 +1167,39 @@ static int cgw_notifier(struct notifier_block *nb,
 
 		hlist_for_each_entry_safe(gwj, n, nx, &cgw_list, list) {
 
-			if (gwj->src.dev == dev || gwj->dst.dev == dev) {
-				hlist_del(&gwj->list);
-				cgw_unregister_filter(gwj);
-				kfree(gwj);
-			}
+			if (cgw_job_uses_dev(gwj, dev))
+				cgw_delete_job(gwj);
 		}
 	}
 
 	return NOTIFY_DONE;
 }
 
+/* sum up the per CPU statistics of a job */
+static void cgw_sum_stats(struct cgw_job *gwj, struct cgw_stats *sum)
+{
+	struct cgw_stats *stats;
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(gwj->stats, cpu);
+
+		sum->handled += stats->handled;
+		sum->dropped += stats->dropped;
+		sum->suppressed += stats->suppressed;
+		sum->deleted += stats->deleted;
+
+		for (i = 0; i < CGW_LAT_BUCKETS; i++)
+			sum->lat_hist[i] += stats->lat_hist[i];
+	}
+}
+
 static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj)
 {
 	struct cgw_frame_mod mb;
+	struct cgw_stats sum;
 	struct rtcanmsg *rtcan;
 	struct nlmsghdr *nlh = nlmsg_put(skb, 0, 0, 0, sizeof(*rtcan), 0);
 	if (!nlh)
@@ -470,18 +1212,68 @@ static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj)
 
 	/* add statistics if available */
 
-	if (gwj->handled_frames) {
-		if (nla_put_u32(skb, CGW_HANDLED, gwj->handled_frames) < 0)
+	cgw_sum_stats(gwj, &sum);
+
+	if (sum.handled) {
+		/* CGW_HANDLED keeps its __u32 size for existing users */
+		if (nla_put_u32(skb, CGW_HANDLED, (u32)sum.handled) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u32));
+
+		if (nla_put_u64(skb, CGW_HANDLED64, sum.handled) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u64));
+	}
+
+	if (sum.dropped) {
+		/* CGW_DROPPED keeps its __u32 size for existing users */
+		if (nla_put_u32(skb, CGW_DROPPED, (u32)sum.dropped) < 0)
 			goto cancel;
 		else
 			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u32));
+
+		if (nla_put_u64(skb, CGW_DROPPED64, sum.dropped) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u64));
 	}
 
-	if (gwj->dropped_frames) {
-		if (nla_put_u32(skb, CGW_DROPPED, gwj->dropped_frames) < 0)
+	if (sum.suppressed) {
+		/* CGW_SUPPRESSED keeps its __u32 size for existing users */
+		if (nla_put_u32(skb, CGW_SUPPRESSED, (u32)sum.suppressed) < 0)
 			goto cancel;
 		else
 			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u32));
+
+		if (nla_put_u64(skb, CGW_SUPPRESSED64, sum.suppressed) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u64));
+	}
+
+	if (sum.deleted) {
+		if (nla_put_u64(skb, CGW_DELETED, sum.deleted) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u64));
+	}
+
+	if (gwj->limit_hops) {
+		if (nla_put_u8(skb, CGW_LIM_HOPS, gwj->limit_hops) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u8));
+	}
+
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST) {
+		if (nla_put(skb, CGW_LAT_HIST, sizeof(sum.lat_hist),
+			    sum.lat_hist) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN +
+				NLA_ALIGN(sizeof(sum.lat_hist));
 	}
 
 	/* check non default settings of attributes */
@@ -531,6 +1323,24 @@ static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj)
 				NLA_ALIGN(CGW_CS_CRC8_LEN);
 	}
 
+	if (gwj->mod.alive.mask) {
+		if (nla_put(skb, CGW_ALIVE_CNT, CGW_ALIVE_CNT_LEN,
+			    &gwj->mod.alive) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + \
+				NLA_ALIGN(CGW_ALIVE_CNT_LEN);
+	}
+
+	if (gwj->crc_tab) {
+		if (nla_put(skb, CGW_CS_CRC, CGW_CS_CRC_LEN,
+			    &gwj->mod.csum.crc) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + \
+				NLA_ALIGN(CGW_CS_CRC_LEN);
+	}
+
 	if (gwj->mod.csumfunc.xor) {
 		if (nla_put(skb, CGW_CS_XOR, CGW_CS_XOR_LEN,
 			    &gwj->mod.csum.xor) < 0)
@@ -540,7 +1350,15 @@ static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj)
 				NLA_ALIGN(CGW_CS_XOR_LEN);
 	}
 
-	if (gwj->gwtype == CGW_TYPE_CAN_CAN) {
+	if (gwj->lim) {
+		if (nla_put(skb, CGW_LIMIT, CGW_LIMIT_LEN, &gwj->limit) < 0)
+			goto cancel;
+		else
+			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(CGW_LIMIT_LEN);
+	}
+
+	if (gwj->gwtype == CGW_TYPE_CAN_CAN ||
+	    gwj->gwtype == CGW_TYPE_CAN_RING) {
 
 		if (gwj->ccgw.filter.can_id || gwj->ccgw.filter.can_mask) {
 			if (nla_put(skb, CGW_FILTER, sizeof(struct can_filter),
@@ -556,10 +1374,29 @@ static int cgw_put_job(struct sk_buff *skb, struct cgw_job *gwj)
 		else
 			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u32));
 
-		if (nla_put_u32(skb, CGW_DST_IF, gwj->ccgw.dst_idx) < 0)
-			goto cancel;
-		else
-			nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(sizeof(u32));
+		if (gwj->gwtype == CGW_TYPE_CAN_RING) {
+			if (nla_put_u32(skb, CGW_RING_ID,
+					gwj->ccgw.ring_id) < 0)
+				goto cancel;
+			else
+				nlh->nlmsg_len += NLA_HDRLEN +
+					NLA_ALIGN(sizeof(u32));
+		} else if (gwj->ccgw.dst_num == 1) {
+			if (nla_put_u32(skb, CGW_DST_IF,
+					gwj->ccgw.dst_idx[0]) < 0)
+				goto cancel;
+			else
+				nlh->nlmsg_len += NLA_HDRLEN +
+					NLA_ALIGN(sizeof(u32));
+		} else {
+			int len = gwj->ccgw.dst_num * sizeof(u32);
+
+			if (nla_put(skb, CGW_DST_IFS, len,
+				    gwj->ccgw.dst_idx) < 0)
+				goto cancel;
+			else
+				nlh->nlmsg_len += NLA_HDRLEN + NLA_ALIGN(len);
+		}
 	}
 
 	return skb->len;
@@ -594,17 +1431,48 @@ cont:
 	return skb->len;
 }
 
+/* check for a set of distinct destination interface indices */
+static int cgw_parse_dst_ifs(struct nlattr *nla, struct can_can_gw *ccgw)
+{
+	int len = nla_len(nla);
+	int i, j;
+
+	if (!len || len % sizeof(u32) || len > CGW_DST_MAX * sizeof(u32))
+		return -EINVAL;
+
+	nla_memcpy(ccgw->dst_idx, nla, len);
+	ccgw->dst_num = len / sizeof(u32);
+
+	for (i = 0; i < ccgw->dst_num; i++) {
+		if (!ccgw->dst_idx[i])
+			return -ENODEV;
+
+		for (j = 0; j < i; j++)
+			if (ccgw->dst_idx[i] == ccgw->dst_idx[j])
+				return -EINVAL;
+	}
+
+	return 0;
+}
+
 /* check for common and gwtype specific attributes */
 static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
-			  u8 gwtype, void *gwtypeattr)
+			  struct cgw_limit *limit, u8 gwtype, void *gwtypeattr,
+			  u8 *limhops)
 {
 	struct nlattr *tb[CGW_MAX+1];
 	struct cgw_frame_mod mb;
-	int modidx = 0;
 	int err = 0;
 
 	/* initialize modification & checksum data space */
 	memset(mod, 0, sizeof(*mod));
+	memset(limit, 0, sizeof(*limit));
+	*limhops = 0;
+
+	/* the fused modification starts with an unmodified CAN frame */
+	mod->fused.and.can_id = ~0U;
+	mod->fused.and.can_dlc = 0xFF;
+	*(u64 *)mod->fused.and.data = ~0ULL;
 
 	err = nlmsg_parse(nlh, sizeof(struct rtcanmsg), tb, CGW_MAX, NULL);
 	if (err < 0)
@@ -619,14 +1487,7 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 		canframecpy(&mod->modframe.and, &mb.cf);
 		mod->modtype.and = mb.modtype;
 
-		if (mb.modtype & CGW_MOD_ID)
-			mod->modfunc[modidx++] = mod_and_id;
-
-		if (mb.modtype & CGW_MOD_DLC)
-			mod->modfunc[modidx++] = mod_and_dlc;
-
-		if (mb.modtype & CGW_MOD_DATA)
-			mod->modfunc[modidx++] = mod_and_data;
+		cgw_fuse_mod(mod, CGW_MOD_AND, &mod->modframe.and, mb.modtype);
 	}
 
 	if (tb[CGW_MOD_OR] &&
@@ -636,14 +1497,7 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 		canframecpy(&mod->modframe.or, &mb.cf);
 		mod->modtype.or = mb.modtype;
 
-		if (mb.modtype & CGW_MOD_ID)
-			mod->modfunc[modidx++] = mod_or_id;
-
-		if (mb.modtype & CGW_MOD_DLC)
-			mod->modfunc[modidx++] = mod_or_dlc;
-
-		if (mb.modtype & CGW_MOD_DATA)
-			mod->modfunc[modidx++] = mod_or_data;
+		cgw_fuse_mod(mod, CGW_MOD_OR, &mod->modframe.or, mb.modtype);
 	}
 
 	if (tb[CGW_MOD_XOR] &&
@@ -653,14 +1507,7 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 		canframecpy(&mod->modframe.xor, &mb.cf);
 		mod->modtype.xor = mb.modtype;
 
-		if (mb.modtype & CGW_MOD_ID)
-			mod->modfunc[modidx++] = mod_xor_id;
-
-		if (mb.modtype & CGW_MOD_DLC)
-			mod->modfunc[modidx++] = mod_xor_dlc;
-
-		if (mb.modtype & CGW_MOD_DATA)
-			mod->modfunc[modidx++] = mod_xor_data;
+		cgw_fuse_mod(mod, CGW_MOD_XOR, &mod->modframe.xor, mb.modtype);
 	}
 
 	if (tb[CGW_MOD_SET] &&
@@ -670,18 +1517,54 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 		canframecpy(&mod->modframe.set, &mb.cf);
 		mod->modtype.set = mb.modtype;
 
-		if (mb.modtype & CGW_MOD_ID)
-			mod->modfunc[modidx++] = mod_set_id;
+		cgw_fuse_mod(mod, CGW_MOD_SET, &mod->modframe.set, mb.modtype);
+	}
+
+	/* check for the alive counter */
+	if (tb[CGW_ALIVE_CNT] &&
+	    nla_len(tb[CGW_ALIVE_CNT]) == CGW_ALIVE_CNT_LEN) {
+
+		struct cgw_alive_cnt *a = &mod->alive;
+		u8 m;
 
-		if (mb.modtype & CGW_MOD_DLC)
-			mod->modfunc[modidx++] = mod_set_dlc;
+		nla_memcpy(a, tb[CGW_ALIVE_CNT], CGW_ALIVE_CNT_LEN);
 
-		if (mb.modtype & CGW_MOD_DATA)
-			mod->modfunc[modidx++] = mod_set_data;
+		if (a->idx < -8 || a->idx > 7 || !a->mask)
+			return -EINVAL;
+
+		/* contiguous mask bits that can hold the max_val */
+		m = a->mask >> (ffs(a->mask) - 1);
+		if (m & (m + 1) || a->max_val > m)
+			return -EINVAL;
 	}
 
+	mod->modified = mod->fused.elems || mod->alive.mask;
+
 	/* check for checksum operations after CAN frame modifications */
-	if (modidx) {
+	if (mod->modified) {
+
+		if (tb[CGW_CS_CRC] &&
+		    nla_len(tb[CGW_CS_CRC]) == CGW_CS_CRC_LEN) {
+
+			struct cgw_csum_crc *c = &mod->csum.crc;
+
+			nla_memcpy(c, tb[CGW_CS_CRC], CGW_CS_CRC_LEN);
+
+			err = cgw_chk_csum_parms(c->from_idx, c->to_idx,
+						 c->result_idx);
+			if (err)
+				return err;
+
+			if ((c->width != 16 && c->width != 32) ||
+			    c->flags & ~(CGW_CRC_REFLECTED|CGW_CRC_RESULT_BE) ||
+			    c->data_id_len > 4)
+				return -EINVAL;
+
+			/* the CRC itself has to fit into data[] */
+			if (c->result_idx >= 0 &&
+			    c->result_idx + c->width / 8 > 8)
+				return -EINVAL;
+		}
 
 		if (tb[CGW_CS_CRC8] &&
 		    nla_len(tb[CGW_CS_CRC8]) == CGW_CS_CRC8_LEN) {
@@ -738,6 +1621,29 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 		}
 	}
 
+	/* check for rate limit & deduplication */
+	if (tb[CGW_LIMIT] && nla_len(tb[CGW_LIMIT]) == CGW_LIMIT_LEN) {
+
+		nla_memcpy(limit, tb[CGW_LIMIT], CGW_LIMIT_LEN);
+
+		if (limit->flags & ~CGW_LIMIT_ON_CHANGE)
+			return -EINVAL;
+
+		/* a rate limit needs to forward at least one frame */
+		if (limit->rate && (!limit->burst ||
+				    limit->rate > NSEC_PER_SEC))
+			return -EINVAL;
+	}
+
+	/* check for a job specific hop limit */
+	if (tb[CGW_LIM_HOPS] && nla_len(tb[CGW_LIM_HOPS]) == sizeof(u8)) {
+
+		*limhops = nla_get_u8(tb[CGW_LIM_HOPS]);
+
+		if (*limhops < 1 || *limhops > max_hops)
+			return -EINVAL;
+	}
+
 	if (gwtype == CGW_TYPE_CAN_CAN) {
 
 		/* check CGW_TYPE_CAN_CAN specific attributes */
@@ -753,38 +1659,249 @@ static int cgw_parse_attr(struct nlmsghdr *nlh, struct cf_mod *mod,
 
 		err = -ENODEV;
 
-		/* specifying two interfaces is mandatory */
-		if (!tb[CGW_SRC_IF] || !tb[CGW_DST_IF])
+		/* specifying source and destination interface(s) is a must */
+		if (!tb[CGW_SRC_IF] || (!tb[CGW_DST_IF] && !tb[CGW_DST_IFS]))
 			return err;
 
+		/* either one destination or a destination set */
+		if (tb[CGW_DST_IF] && tb[CGW_DST_IFS])
+			return -EINVAL;
+
 		if (nla_len(tb[CGW_SRC_IF]) == sizeof(u32))
 			nla_memcpy(&ccgw->src_idx, tb[CGW_SRC_IF],
 				   sizeof(u32));
 
-		if (nla_len(tb[CGW_DST_IF]) == sizeof(u32))
-			nla_memcpy(&ccgw->dst_idx, tb[CGW_DST_IF],
-				   sizeof(u32));
+		if (tb[CGW_DST_IF]) {
+			if (nla_len(tb[CGW_DST_IF]) == sizeof(u32))
+				nla_memcpy(&ccgw->dst_idx[0], tb[CGW_DST_IF],
+					   sizeof(u32));
+			ccgw->dst_num = 1;
+		} else {
+			err = cgw_parse_dst_ifs(tb[CGW_DST_IFS], ccgw);
+			if (err)
+				return err;
+			err = -ENODEV;
+		}
 
 		/* both indices set to 0 for flushing all routing entries */
-		if (!ccgw->src_idx && !ccgw->dst_idx)
+		if (!ccgw->src_idx && !ccgw->dst_idx[0])
 			return 0;
 
 		/* only one index set to 0 is an error */
-		if (!ccgw->src_idx || !ccgw->dst_idx)
+		if (!ccgw->src_idx || !ccgw->dst_idx[0])
 			return err;
 	}
 
+	if (gwtype == CGW_TYPE_CAN_RING) {
+
+		/* check CGW_TYPE_CAN_RING specific attributes */
+
+		struct can_can_gw *ccgw = (struct can_can_gw *)gwtypeattr;
+		memset(ccgw, 0, sizeof(*ccgw));
+
+		/* check for can_filter in attributes */
+		if (tb[CGW_FILTER] &&
+		    nla_len(tb[CGW_FILTER]) == sizeof(struct can_filter))
+			nla_memcpy(&ccgw->filter, tb[CGW_FILTER],
+				   sizeof(struct can_filter));
+
+		/* no destination interfaces for the userspace ring */
+		if (tb[CGW_DST_IF] || tb[CGW_DST_IFS])
+			return -EINVAL;
+
+		if (tb[CGW_SRC_IF] && nla_len(tb[CGW_SRC_IF]) == sizeof(u32))
+			nla_memcpy(&ccgw->src_idx, tb[CGW_SRC_IF],
+				   sizeof(u32));
+
+		if (tb[CGW_RING_ID] && nla_len(tb[CGW_RING_ID]) == sizeof(u32))
+			nla_memcpy(&ccgw->ring_id, tb[CGW_RING_ID],
+				   sizeof(u32));
+
+		/* specifying source interface and ring is a must */
+		if (!ccgw->src_idx || !ccgw->ring_id)
+			return -ENODEV;
+	}
+
 	/* add the checks for other gwtypes here */
 
 	return 0;
 }
 
+/* find the userspace ring for CGW_TYPE_CAN_RING jobs (RTNL held) */
+static struct cgw_ring *cgw_find_ring(u32 id)
+{
+	struct cgw_ring *ring;
+
+	list_for_each_entry(ring, &cgw_rings, list) {
+		if (ring->id == id)
+			return ring;
+	}
+
+	return NULL;
+}
+
+static int cgw_ring_open(struct inode *inode, struct file *file)
+{
+	struct cgw_ring *ring;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&ring->list);
+	spin_lock_init(&ring->lock);
+	init_waitqueue_head(&ring->wait);
+
+	file->private_data = ring;
+
+	return 0;
+}
+
+static long cgw_ring_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct cgw_ring *ring = file->private_data;
+	struct can_raw_ring_slot *slots;
+	struct cgw_ring_req req;
+
+	if (cmd != CGW_RING_SETUP)
+		return -ENOIOCTLCMD;
+
+	if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!req.slot_nr || req.slot_nr > INT_MAX / sizeof(*slots))
+		return -EINVAL;
+
+	/* zeroed memory => all slots in CAN_RAW_SLOT_KERNEL state */
+	slots = vmalloc_user(PAGE_ALIGN(req.slot_nr * sizeof(*slots)));
+	if (!slots)
+		return -ENOMEM;
+
+	/* only one ring per open file that can not be resized */
+	spin_lock_bh(&ring->lock);
+	if (ring->slots) {
+		spin_unlock_bh(&ring->lock);
+		vfree(slots);
+		return -EBUSY;
+	}
+	ring->slots   = slots;
+	ring->slot_nr = req.slot_nr;
+	spin_unlock_bh(&ring->lock);
+
+	rtnl_lock();
+
+	/* get an unused ring id != 0 */
+	do {
+		if (!++cgw_ring_id)
+			cgw_ring_id++;
+	} while (cgw_find_ring(cgw_ring_id));
+
+	ring->id = cgw_ring_id;
+	list_add(&ring->list, &cgw_rings);
+
+	rtnl_unlock();
+
+	req.ring_id = ring->id;
+	if (copy_to_user((void __user *)arg, &req, sizeof(req)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int cgw_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct cgw_ring *ring = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct can_raw_ring_slot *slots;
+	unsigned int slot_nr;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	/* the ring memory is only released when the file is closed */
+	spin_lock_bh(&ring->lock);
+	slots   = ring->slots;
+	slot_nr = ring->slot_nr;
+	spin_unlock_bh(&ring->lock);
+
+	if (!slots || size != PAGE_ALIGN(slot_nr * sizeof(*slots)))
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, slots, 0);
+}
+
+static unsigned int cgw_ring_poll(struct file *file, poll_table *wait)
+{
+	struct cgw_ring *ring = file->private_data;
+	unsigned int mask = 0;
+	unsigned int last;
+
+	poll_wait(file, &ring->wait, wait);
+
+	/* the latest filled slot of the ring has not been consumed yet */
+	spin_lock_bh(&ring->lock);
+	if (ring->slots) {
+		last = ring->head ? ring->head - 1 : ring->slot_nr - 1;
+		if (ring->slots[last].status != CAN_RAW_SLOT_KERNEL)
+			mask |= POLLIN | POLLRDNORM;
+	}
+	spin_unlock_bh(&ring->lock);
+
+	return mask;
+}
+
+static int cgw_ring_release(struct inode *inode, struct file *file)
+{
+	struct cgw_ring *ring = file->private_data;
+	struct cgw_job *gwj = NULL;
+	struct hlist_node *n, *nx;
+
+	rtnl_lock();
+
+	/* remove the gateway jobs that deliver into this ring */
+	hlist_for_each_entry_safe(gwj, n, nx, &cgw_list, list) {
+		if (gwj->gwtype == CGW_TYPE_CAN_RING && gwj->dst.ring == ring)
+			cgw_delete_job(gwj);
+	}
+
+	list_del(&ring->list);
+
+	rtnl_unlock();
+
+	/* can_ring_gw_rcv() may still be running on another CPU */
+	synchronize_rcu();
+
+	vfree(ring->slots);
+	kfree(ring);
+
+	return 0;
+}
+
+static const struct file_operations cgw_ring_fops = {
+	.owner		= THIS_MODULE,
+	.open		= cgw_ring_open,
+	.release	= cgw_ring_release,
+	.unlocked_ioctl	= cgw_ring_ioctl,
+	.compat_ioctl	= cgw_ring_ioctl,
+	.mmap		= cgw_ring_mmap,
+	.poll		= cgw_ring_poll,
+};
+
+static struct miscdevice cgw_ring_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "can-gw",
+	.fops	= &cgw_ring_fops,
+};
+
 static int cgw_create_job(struct sk_buff *skb,  struct nlmsghdr *nlh,
 			  void *arg)
 {
 	struct rtcanmsg *r;
 	struct cgw_job *gwj;
+	struct net_device *dev;
 	int err = 0;
+	int i;
 
 	if (nlmsg_len(nlh) < sizeof(*r))
 		return -EINVAL;
@@ -793,29 +1910,71 @@ static int cgw_create_job(struct sk_buff *skb,  struct nlmsghdr *nlh,
 	if (r->can_family != AF_CAN)
 		return -EPFNOSUPPORT;
 
-	/* so far we only support CAN -> CAN routings */
-	if (r->gwtype != CGW_TYPE_CAN_CAN)
+	/* so far we support CAN -> CAN routings and CAN -> ring jobs */
+	if (r->gwtype != CGW_TYPE_CAN_CAN && r->gwtype != CGW_TYPE_CAN_RING)
 		return -EINVAL;
 
 	gwj = kmem_cache_alloc(cgw_cache, GFP_KERNEL);
 	if (!gwj)
 		return -ENOMEM;
 
-	gwj->handled_frames = 0;
-	gwj->dropped_frames = 0;
 	gwj->flags = r->flags;
 	gwj->gwtype = r->gwtype;
+	gwj->lim = NULL;
+	gwj->crc_tab = NULL;
+
+	gwj->stats = alloc_percpu(struct cgw_stats);
+	if (!gwj->stats) {
+		err = -ENOMEM;
+		goto out;
+	}
 
-	err = cgw_parse_attr(nlh, &gwj->mod, CGW_TYPE_CAN_CAN, &gwj->ccgw);
+	err = cgw_parse_attr(nlh, &gwj->mod, &gwj->limit, r->gwtype,
+			     &gwj->ccgw, &gwj->limit_hops);
 	if (err < 0)
 		goto out;
 
+	if (gwj->limit.rate || gwj->limit.interval || gwj->limit.flags) {
+		err = -ENOMEM;
+		gwj->lim = cgw_alloc_lim(&gwj->limit);
+		if (!gwj->lim)
+			goto out;
+	}
+
+	if (gwj->mod.csum.crc.width) {
+		struct cgw_csum_crc *c = &gwj->mod.csum.crc;
+		u8 refl = (c->flags & CGW_CRC_REFLECTED) ? 1 : 0;
+
+		err = -ENOMEM;
+		gwj->crc_tab = cgw_get_crc_tab(c->poly, c->width, refl);
+		if (!gwj->crc_tab)
+			goto out;
+
+		/* initial value of the CRC register - see cgw_init_crc_tab() */
+		if (refl)
+			gwj->crc_init = cgw_reflect(c->init_crc_val, c->width);
+		else
+			gwj->crc_init = c->init_crc_val << (32 - c->width);
+	}
+
+	/* the first forwarded frame gets the alive counter value 0 */
+	atomic_set(&gwj->alive_cnt, gwj->mod.alive.max_val);
+
 	err = -ENODEV;
 
 	/* ifindex == 0 is not allowed for job creation */
-	if (!gwj->ccgw.src_idx || !gwj->ccgw.dst_idx)
+	if (!gwj->ccgw.src_idx ||
+	    (gwj->gwtype == CGW_TYPE_CAN_CAN && !gwj->ccgw.dst_idx[0]))
 		goto out;
 
+	ASSERT_RTNL();
+
+	if (gwj->gwtype == CGW_TYPE_CAN_RING) {
+		gwj->dst.ring = cgw_find_ring(gwj->ccgw.ring_id);
+		if (!gwj->dst.ring)
+			goto out;
+	}
+
 	gwj->src.dev = dev_get_by_index(&init_net, gwj->ccgw.src_idx);
 
 	if (!gwj->src.dev)
@@ -825,33 +1984,51 @@ static int cgw_create_job(struct sk_buff *skb,  struct nlmsghdr *nlh,
 	if (gwj->src.dev->type != ARPHRD_CAN || gwj->src.dev->header_ops)
 		goto put_src_out;
 
-	gwj->dst.dev = dev_get_by_index(&init_net, gwj->ccgw.dst_idx);
+	/*
+	 * The destination devices are not referenced by the job as the
+	 * notifier removes the job when one of its devices is unregistered.
+	 * Holding the RTNL the devices can not vanish while being checked.
+	 */
+	for (i = 0; i < gwj->ccgw.dst_num; i++) {
 
-	if (!gwj->dst.dev)
-		goto put_src_out;
+		dev = dev_get_by_index(&init_net, gwj->ccgw.dst_idx[i]);
+		if (!dev)
+			goto put_src_out;
 
-	/* check for CAN netdev not using header_ops - see gw_rcv() */
-	if (gwj->dst.dev->type != ARPHRD_CAN || gwj->dst.dev->header_ops)
-		goto put_src_dst_out;
+		gwj->dst.dev[i] = dev;
+		dev_put(dev);
 
-	ASSERT_RTNL();
+		/* check for CAN netdev not using header_ops - see gw_rcv() */
+		if (dev->type != ARPHRD_CAN || dev->header_ops)
+			goto put_src_out;
+	}
+
+	/* get rx timestamps for the latency histogram */
+	if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		net_enable_timestamp();
 
 	err = cgw_register_filter(gwj);
-	if (!err)
+	if (!err) {
 		hlist_add_head_rcu(&gwj->list, &cgw_list);
+		hlist_add_head(&gwj->hlist, cgw_hash_head(&gwj->ccgw));
+	} else if (gwj->flags & CGW_FLAGS_CAN_LAT_HIST)
+		net_disable_timestamp();
 
-put_src_dst_out:
-	dev_put(gwj->dst.dev);
 put_src_out:
 	dev_put(gwj->src.dev);
 out:
-	if (err)
-		kmem_cache_free(cgw_cache, gwj);
+	if (err) {
+		if (gwj->crc_tab)
+			cgw_put_crc_tab(gwj->crc_tab);
+
+		cgw_free_job(gwj);
+	}
 
 	return err;
 }
 
-static void cgw_remove_all_jobs(void)
+/* remove all jobs of the given gwtype (CGW_TYPE_UNSPEC => all jobs) */
+static void cgw_remove_all_jobs(u8 gwtype)
 {
 	struct cgw_job *gwj = NULL;
 	struct hlist_node *n, *nx;
@@ -859,19 +2036,20 @@ static void cgw_remove_all_jobs(void)
 	ASSERT_RTNL();
 
 	hlist_for_each_entry_safe(gwj, n, nx, &cgw_list, list) {
-		hlist_del(&gwj->list);
-		cgw_unregister_filter(gwj);
-		kfree(gwj);
+		if (gwtype == CGW_TYPE_UNSPEC || gwj->gwtype == gwtype)
+			cgw_delete_job(gwj);
 	}
 }
 
 static int cgw_remove_job(struct sk_buff *skb,  struct nlmsghdr *nlh, void *arg)
 {
 	struct cgw_job *gwj = NULL;
-	struct hlist_node *n, *nx;
+	struct hlist_node *n;
 	struct rtcanmsg *r;
 	struct cf_mod mod;
+	struct cgw_limit limit;
 	struct can_can_gw ccgw;
+	u8 limhops = 0;
 	int err = 0;
 
 	if (nlmsg_len(nlh) < sizeof(*r))
@@ -881,17 +2059,21 @@ static int cgw_remove_job(struct sk_buff *skb,  struct nlmsghdr *nlh, void *arg)
 	if (r->can_family != AF_CAN)
 		return -EPFNOSUPPORT;
 
-	/* so far we only support CAN -> CAN routings */
-	if (r->gwtype != CGW_TYPE_CAN_CAN)
+	/* so far we support CAN -> CAN routings and CAN -> ring jobs */
+	if (r->gwtype != CGW_TYPE_CAN_CAN && r->gwtype != CGW_TYPE_CAN_RING)
 		return -EINVAL;
 
-	err = cgw_parse_attr(nlh, &mod, CGW_TYPE_CAN_CAN, &ccgw);
+	err = cgw_parse_attr(nlh, &mod, &limit, r->gwtype, &ccgw, &limhops);
 	if (err < 0)
 		return err;
 
-	/* two interface indices both set to 0 => remove all entries */
-	if (!ccgw.src_idx && !ccgw.dst_idx) {
-		cgw_remove_all_jobs();
+	/*
+	 * two interface indices both set to 0 => remove all CAN -> CAN
+	 * entries. The ring jobs belong to their ring device users.
+	 */
+	if (r->gwtype == CGW_TYPE_CAN_CAN &&
+	    !ccgw.src_idx && !ccgw.dst_idx[0]) {
+		cgw_remove_all_jobs(CGW_TYPE_CAN_CAN);
 		return 0;
 	}
 
@@ -900,21 +2082,25 @@ static int cgw_remove_job(struct sk_buff *skb,  struct nlmsghdr *nlh, void *arg)
 	ASSERT_RTNL();
 
 	/* remove only the first matching entry */
-	hlist_for_each_entry_safe(gwj, n, nx, &cgw_list, list) {
+	hlist_for_each_entry(gwj, n, cgw_hash_head(&ccgw), hlist) {
 
-		if (gwj->flags != r->flags)
+		if (gwj->gwtype != r->gwtype || gwj->flags != r->flags)
 			continue;
 
 		if (memcmp(&gwj->mod, &mod, sizeof(mod)))
 			continue;
 
-		/* if (r->gwtype == CGW_TYPE_CAN_CAN) - is made sure here */
+		if (memcmp(&gwj->limit, &limit, sizeof(limit)))
+			continue;
+
+		if (gwj->limit_hops != limhops)
+			continue;
+
+		/* CAN -> CAN and CAN -> ring jobs both use ccgw */
 		if (memcmp(&gwj->ccgw, &ccgw, sizeof(ccgw)))
 			continue;
 
-		hlist_del(&gwj->list);
-		cgw_unregister_filter(gwj);
-		kfree(gwj);
+		cgw_delete_job(gwj);
 		err = 0;
 		break;
 	}
@@ -924,6 +2110,9 @@ static int cgw_remove_job(struct sk_buff *skb,  struct nlmsghdr *nlh, void *arg)
 
 static __init int cgw_module_init(void)
 {
+	/* sanitize given module parameter */
+	max_hops = clamp_t(unsigned int, max_hops, CGW_MIN_HOPS, CGW_MAX_HOPS);
+
 	printk(banner);
 
 	cgw_cache = kmem_cache_create("can_gw", sizeof(struct cgw_job),
@@ -936,11 +2125,19 @@ static __init int cgw_module_init(void)
 	notifier.notifier_call = cgw_notifier;
 	register_netdevice_notifier(&notifier);
 
+	/* character device for the userspace rings of CGW_TYPE_CAN_RING */
+	if (misc_register(&cgw_ring_dev)) {
+		unregister_netdevice_notifier(&notifier);
+		kmem_cache_destroy(cgw_cache);
+		return -ENODEV;
+	}
+
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,1,0)
 	if (__rtnl_register(PF_CAN, RTM_GETROUTE, NULL, cgw_dump_jobs, NULL)) {
 #else
 	if (__rtnl_register(PF_CAN, RTM_GETROUTE, NULL, cgw_dump_jobs)) {
 #endif
+		misc_deregister(&cgw_ring_dev);
 		unregister_netdevice_notifier(&notifier);
 		kmem_cache_destroy(cgw_cache);
 		return -ENOBUFS;
@@ -962,10 +2159,13 @@ static __exit void cgw_module_exit(void)
 {
 	rtnl_unregister_all(PF_CAN);
 
+	/* all rings are released as the module is not in use anymore */
+	misc_deregister(&cgw_ring_dev);
+
 	unregister_netdevice_notifier(&notifier);
 
 	rtnl_lock();
-	cgw_remove_all_jobs();
+	cgw_remove_all_jobs(CGW_TYPE_UNSPEC);
 	rtnl_unlock();
 
 	rcu_barrier(); /* Wait for completion of call_rcu()'s */
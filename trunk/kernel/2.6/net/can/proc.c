@@ -83,12 +83,13 @@ static struct proc_dir_entry *pde_rcvlist_err;
 
 static int user_reset;
 
+/* frame counters at the last can_stat_update() for the 'current rate' */
+static struct s_cpu_stats can_stats_last;
+
 static const char rx_list_name[][8] = {
 	[RX_ERR] = "rx_err",
 	[RX_ALL] = "rx_all",
-	[RX_FIL] = "rx_fil",
 	[RX_INV] = "rx_inv",
-	[RX_EFF] = "rx_eff",
 };
 
 /*
@@ -102,9 +103,17 @@ static void can_init_stats(void)
 	 * can_stattimer is active which is the default) OR in a process
 	 * context (reading the proc_fs when can_stattimer is disabled).
 	 */
+	int cpu;
+
 	memset(&can_stats, 0, sizeof(can_stats));
+	memset(&can_stats_last, 0, sizeof(can_stats_last));
 	can_stats.jiffies_init = jiffies;
 
+	/* concurrent updates in the rx/tx path may get lost here */
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(can_cpu_stats, cpu), 0,
+		       sizeof(struct s_cpu_stats));
+
 	can_pstats.stats_reset++;
 
 	if (user_reset) {
@@ -113,6 +122,29 @@ static void can_init_stats(void)
 	}
 }
 
+/*
+ * can_sum_stats - sum up the per-CPU frame counters into can_stats
+ */
+static void can_sum_stats(void)
+{
+	struct s_cpu_stats *stats;
+	unsigned long rx_frames = 0;
+	unsigned long tx_frames = 0;
+	unsigned long matches = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(can_cpu_stats, cpu);
+		rx_frames += stats->rx_frames;
+		tx_frames += stats->tx_frames;
+		matches   += stats->matches;
+	}
+
+	can_stats.rx_frames = rx_frames;
+	can_stats.tx_frames = tx_frames;
+	can_stats.matches   = matches;
+}
+
 static unsigned long calc_rate(unsigned long oldjif, unsigned long newjif,
 			       unsigned long count)
 {
@@ -145,6 +177,8 @@ void can_stat_update(unsigned long data)
 	if (j < can_stats.jiffies_init)
 		can_init_stats();
 
+	can_sum_stats();
+
 	/* prevent overflow in calc_rate() */
 	if (can_stats.rx_frames > (ULONG_MAX / HZ))
 		can_init_stats();
@@ -157,6 +191,14 @@ void can_stat_update(unsigned long data)
 	if (can_stats.matches > (ULONG_MAX / 100))
 		can_init_stats();
 
+	/* calc the frames since the last update */
+	can_stats.rx_frames_delta = can_stats.rx_frames -
+		can_stats_last.rx_frames;
+	can_stats.tx_frames_delta = can_stats.tx_frames -
+		can_stats_last.tx_frames;
+	can_stats.matches_delta   = can_stats.matches -
+		can_stats_last.matches;
+
 	/* calc total values */
 	if (can_stats.rx_frames)
 		can_stats.total_rx_match_ratio = (can_stats.matches * 100) /
@@ -186,15 +228,92 @@ void can_stat_update(unsigned long data)
 	if (can_stats.max_rx_match_ratio < can_stats.current_rx_match_ratio)
 		can_stats.max_rx_match_ratio = can_stats.current_rx_match_ratio;
 
-	/* clear values for 'current rate' calculation */
-	can_stats.tx_frames_delta = 0;
-	can_stats.rx_frames_delta = 0;
-	can_stats.matches_delta   = 0;
+	/* remember values for 'current rate' calculation */
+	can_stats_last.rx_frames = can_stats.rx_frames;
+	can_stats_last.tx_frames = can_stats.tx_frames;
+	can_stats_last.matches   = can_stats.matches;
 
 	/* restart timer (one second) */
 	mod_timer(&can_stattimer, round_jiffies(jiffies + HZ));
 }
 
+/*
+ * can_rcv_slot_used - get a non-empty filterlist of a sparse table
+ *
+ * Return:
+ *  Pointer to the filterlist or NULL when it is empty or not allocated.
+ */
+static struct hlist_head *can_rcv_slot_used(struct hlist_head **tab, int idx)
+{
+	struct hlist_head *rl = can_rcv_slot(tab, idx);
+
+	return (rl && !hlist_empty(rl)) ? rl : NULL;
+}
+
+/*
+ * can_eff_hash_usage - collect occupancy of the single EFF can_id hash table
+ * @d: pointer to the device filter struct
+ * @entries: returns the number of entries in all hash buckets
+ * @maxlen: returns the length of the longest hash chain
+ *
+ * Return:
+ *  Number of non-empty hash buckets
+ */
+static int can_eff_hash_usage(struct dev_rcv_lists *d, int *entries,
+			      int *maxlen)
+{
+	struct receiver *r;
+	struct hlist_head *rl;
+	struct hlist_node *n;
+	int i, len, used = 0;
+
+	*entries = 0;
+	*maxlen = 0;
+
+	for (i = 0; i < CAN_EFF_RCV_ARRAY_SZ; i++) {
+		rl = can_rcv_slot_used(d->rx_eff, i);
+		if (!rl)
+			continue;
+
+		len = 0;
+		hlist_for_each_entry_rcu(r, n, rl, list)
+			len++;
+
+		if (len) {
+			used++;
+			*entries += len;
+			if (*maxlen < len)
+				*maxlen = len;
+		}
+	}
+
+	return used;
+}
+
+/*
+ * can_fil_group_usage - collect usage of the can_id/mask filter groups
+ * @d: pointer to the device filter struct
+ * @entries: returns the number of entries in all filter groups
+ *
+ * Return:
+ *  Number of filter groups (different mask values)
+ */
+static int can_fil_group_usage(struct dev_rcv_lists *d, int *entries)
+{
+	struct rcv_mask_group *g;
+	struct hlist_node *n;
+	int groups = 0;
+
+	*entries = 0;
+
+	hlist_for_each_entry_rcu(g, n, &d->rx_fil, list) {
+		groups++;
+		*entries += g->entries;
+	}
+
+	return groups;
+}
+
 /*
  * proc read functions
  *
@@ -221,7 +340,7 @@ static void can_print_rcvlist(struct seq_file *m, struct hlist_head *rx_list,
 #endif
 
 		seq_printf(m, fmt, DNAME(dev), r->can_id, r->mask,
-				r->func, r->data, r->matches, r->ident);
+				r->func, r->data, can_rcv_matches(r), r->ident);
 	}
 }
 
@@ -237,6 +356,8 @@ static void can_print_recv_banner(struct seq_file *m)
 
 static int can_stats_proc_show(struct seq_file *m, void *v)
 {
+	can_sum_stats();
+
 	seq_putc(m, '\n');
 	seq_printf(m, " %8ld transmitted frames (TXF)\n", can_stats.tx_frames);
 	seq_printf(m, " %8ld received frames (RXF)\n", can_stats.rx_frames);
@@ -280,6 +401,8 @@ static int can_stats_proc_show(struct seq_file *m, void *v)
 			can_pstats.rcv_entries);
 	seq_printf(m, " %8ld maximum receive list entries (MRCV)\n",
 			can_pstats.rcv_entries_max);
+	seq_printf(m, " %8d bytes receive list memory (RCVM)\n",
+			atomic_read(&can_pstats.rcv_lists_mem));
 
 	if (can_pstats.stats_reset)
 		seq_printf(m, "\n %8ld statistic resets (STR)\n",
@@ -396,6 +519,7 @@ static const struct file_operations can_rcvlist_proc_fops = {
 static int can_rcvlist_sff_proc_show(struct seq_file *m, void *v)
 {
 	struct dev_rcv_lists *d;
+	struct hlist_head *rl;
 	struct hlist_node *n;
 
 	/* RX_SFF */
@@ -405,18 +529,18 @@ static int can_rcvlist_sff_proc_show(struct seq_file *m, void *v)
 	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
 		int i, all_empty = 1;
 		/* check wether at least one list is non-empty */
-		for (i = 0; i < 0x800; i++)
-			if (!hlist_empty(&d->rx_sff[i])) {
+		for (i = 0; i < CAN_SFF_RCV_ARRAY_SZ; i++)
+			if (can_rcv_slot_used(d->rx_sff, i)) {
 				all_empty = 0;
 				break;
 			}
 
 		if (!all_empty) {
 			can_print_recv_banner(m);
-			for (i = 0; i < 0x800; i++) {
-				if (!hlist_empty(&d->rx_sff[i]))
-					can_print_rcvlist(m, &d->rx_sff[i],
-							  d->dev);
+			for (i = 0; i < CAN_SFF_RCV_ARRAY_SZ; i++) {
+				rl = can_rcv_slot_used(d->rx_sff, i);
+				if (rl)
+					can_print_rcvlist(m, rl, d->dev);
 			}
 		} else
 			seq_printf(m, "  (%s: no entry)\n", DNAME(d->dev));
@@ -439,6 +563,102 @@ static const struct file_operations can_rcvlist_sff_proc_fops = {
 	.llseek		= seq_lseek,
 	.release	= single_release,
 };
+
+static int can_rcvlist_fil_proc_show(struct seq_file *m, void *v)
+{
+	struct dev_rcv_lists *d;
+	struct rcv_mask_group *g;
+	struct hlist_node *n, *gn;
+
+	/* RX_FIL */
+	seq_puts(m, "\nreceive list 'rx_fil':\n");
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
+		int i, groups, entries;
+
+		groups = can_fil_group_usage(d, &entries);
+
+		if (groups) {
+			can_print_recv_banner(m);
+			hlist_for_each_entry_rcu(g, gn, &d->rx_fil, list) {
+				for (i = 0; i < CAN_FIL_RCV_ARRAY_SZ; i++) {
+					if (!hlist_empty(&g->rx[i]))
+						can_print_rcvlist(m, &g->rx[i],
+								  d->dev);
+				}
+			}
+			seq_printf(m, "  (%s: %d entries in %d filter groups)\n",
+				   DNAME(d->dev), entries, groups);
+		} else
+			seq_printf(m, "  (%s: no entry)\n", DNAME(d->dev));
+	}
+	rcu_read_unlock();
+
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static int can_rcvlist_fil_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, can_rcvlist_fil_proc_show, NULL);
+}
+
+static const struct file_operations can_rcvlist_fil_proc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= can_rcvlist_fil_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int can_rcvlist_eff_proc_show(struct seq_file *m, void *v)
+{
+	struct dev_rcv_lists *d;
+	struct hlist_head *rl;
+	struct hlist_node *n;
+
+	/* RX_EFF */
+	seq_puts(m, "\nreceive list 'rx_eff':\n");
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
+		int i, used, entries, maxlen;
+
+		used = can_eff_hash_usage(d, &entries, &maxlen);
+
+		if (used) {
+			can_print_recv_banner(m);
+			for (i = 0; i < CAN_EFF_RCV_ARRAY_SZ; i++) {
+				rl = can_rcv_slot_used(d->rx_eff, i);
+				if (rl)
+					can_print_rcvlist(m, rl, d->dev);
+			}
+			seq_printf(m, "  (%s: %d entries in %d of %d hash "
+				   "buckets, max. chain length %d)\n",
+				   DNAME(d->dev), entries, used,
+				   CAN_EFF_RCV_ARRAY_SZ, maxlen);
+		} else
+			seq_printf(m, "  (%s: no entry)\n", DNAME(d->dev));
+	}
+	rcu_read_unlock();
+
+	seq_putc(m, '\n');
+	return 0;
+}
+
+static int can_rcvlist_eff_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, can_rcvlist_eff_proc_show, NULL);
+}
+
+static const struct file_operations can_rcvlist_eff_proc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= can_rcvlist_eff_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 #else
 static int can_print_rcvlist(char *page, int len, struct hlist_head *rx_list,
 			     struct net_device *dev)
@@ -454,7 +674,7 @@ static int can_print_rcvlist(char *page, int len, struct hlist_head *rx_list,
 		len += snprintf(page + len, PAGE_SIZE - len, fmt,
 				DNAME(dev), r->can_id, r->mask,
 				(unsigned long)r->func, (unsigned long)r->data,
-				r->matches, r->ident);
+				can_rcv_matches(r), r->ident);
 
 		/* does a typical line fit into the current buffer? */
 
@@ -488,6 +708,8 @@ static int can_proc_read_stats(char *page, char **start, off_t off,
 {
 	int len = 0;
 
+	can_sum_stats();
+
 	len += snprintf(page + len, PAGE_SIZE - len, "\n");
 	len += snprintf(page + len, PAGE_SIZE - len,
 			" %8ld transmitted frames (TXF)\n",
@@ -546,6 +768,9 @@ static int can_proc_read_stats(char *page, char **start, off_t off,
 	len += snprintf(page + len, PAGE_SIZE - len,
 			" %8ld maximum receive list entries (MRCV)\n",
 			can_pstats.rcv_entries_max);
+	len += snprintf(page + len, PAGE_SIZE - len,
+			" %8d bytes receive list memory (RCVM)\n",
+			atomic_read(&can_pstats.rcv_lists_mem));
 
 	if (can_pstats.stats_reset)
 		len += snprintf(page + len, PAGE_SIZE - len,
@@ -638,6 +863,7 @@ static int can_proc_read_rcvlist_sff(char *page, char **start, off_t off,
 {
 	int len = 0;
 	struct dev_rcv_lists *d;
+	struct hlist_head *rl;
 	struct hlist_node *n;
 
 	/* RX_SFF */
@@ -648,19 +874,18 @@ static int can_proc_read_rcvlist_sff(char *page, char **start, off_t off,
 	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
 		int i, all_empty = 1;
 		/* check wether at least one list is non-empty */
-		for (i = 0; i < 0x800; i++)
-			if (!hlist_empty(&d->rx_sff[i])) {
+		for (i = 0; i < CAN_SFF_RCV_ARRAY_SZ; i++)
+			if (can_rcv_slot_used(d->rx_sff, i)) {
 				all_empty = 0;
 				break;
 			}
 
 		if (!all_empty) {
 			len = can_print_recv_banner(page, len);
-			for (i = 0; i < 0x800; i++) {
-				if (!hlist_empty(&d->rx_sff[i]) &&
-				    len < PAGE_SIZE - 100)
-					len = can_print_rcvlist(page, len,
-								&d->rx_sff[i],
+			for (i = 0; i < CAN_SFF_RCV_ARRAY_SZ; i++) {
+				rl = can_rcv_slot_used(d->rx_sff, i);
+				if (rl && len < PAGE_SIZE - 100)
+					len = can_print_rcvlist(page, len, rl,
 								d->dev);
 			}
 		} else
@@ -678,6 +903,101 @@ static int can_proc_read_rcvlist_sff(char *page, char **start, off_t off,
 	*eof = 1;
 	return len;
 }
+
+static int can_proc_read_rcvlist_fil(char *page, char **start, off_t off,
+				     int count, int *eof, void *data)
+{
+	int len = 0;
+	struct dev_rcv_lists *d;
+	struct rcv_mask_group *g;
+	struct hlist_node *n, *gn;
+
+	/* RX_FIL */
+	len += snprintf(page + len, PAGE_SIZE - len,
+			"\nreceive list 'rx_fil':\n");
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
+		int i, groups, entries;
+
+		groups = can_fil_group_usage(d, &entries);
+
+		if (groups) {
+			len = can_print_recv_banner(page, len);
+			hlist_for_each_entry_rcu(g, gn, &d->rx_fil, list) {
+				for (i = 0; i < CAN_FIL_RCV_ARRAY_SZ; i++) {
+					if (!hlist_empty(&g->rx[i]) &&
+					    len < PAGE_SIZE - 100)
+						len = can_print_rcvlist(page,
+							len, &g->rx[i], d->dev);
+				}
+			}
+			len += snprintf(page + len, PAGE_SIZE - len,
+					"  (%s: %d entries in %d filter "
+					"groups)\n", DNAME(d->dev), entries,
+					groups);
+		} else
+			len += snprintf(page + len, PAGE_SIZE - len,
+					"  (%s: no entry)\n", DNAME(d->dev));
+
+		/* exit on end of buffer? */
+		if (len > PAGE_SIZE - 100)
+			break;
+	}
+	rcu_read_unlock();
+
+	len += snprintf(page + len, PAGE_SIZE - len, "\n");
+
+	*eof = 1;
+	return len;
+}
+
+static int can_proc_read_rcvlist_eff(char *page, char **start, off_t off,
+				     int count, int *eof, void *data)
+{
+	int len = 0;
+	struct dev_rcv_lists *d;
+	struct hlist_head *rl;
+	struct hlist_node *n;
+
+	/* RX_EFF */
+	len += snprintf(page + len, PAGE_SIZE - len,
+			"\nreceive list 'rx_eff':\n");
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(d, n, &can_rx_dev_list, list) {
+		int i, used, entries, maxlen;
+
+		used = can_eff_hash_usage(d, &entries, &maxlen);
+
+		if (used) {
+			len = can_print_recv_banner(page, len);
+			for (i = 0; i < CAN_EFF_RCV_ARRAY_SZ; i++) {
+				rl = can_rcv_slot_used(d->rx_eff, i);
+				if (rl && len < PAGE_SIZE - 100)
+					len = can_print_rcvlist(page, len, rl,
+								d->dev);
+			}
+			len += snprintf(page + len, PAGE_SIZE - len,
+					"  (%s: %d entries in %d of %d hash "
+					"buckets, max. chain length %d)\n",
+					DNAME(d->dev), entries, used,
+					CAN_EFF_RCV_ARRAY_SZ, maxlen);
+		} else
+			len += snprintf(page + len, PAGE_SIZE - len,
+					"  (%s: no entry)\n", DNAME(d->dev));
+
+		/* exit on end of buffer? */
+		if (len > PAGE_SIZE - 100)
+			break;
+	}
+	rcu_read_unlock();
+
+	len += snprintf(page + len, PAGE_SIZE - len, "\n");
+
+	*eof = 1;
+	return len;
+}
 #endif
 
 /*
@@ -738,12 +1058,12 @@ void can_init_proc(void)
 					   &can_rcvlist_proc_fops, (void *)RX_ERR);
 	pde_rcvlist_all = proc_create_data(CAN_PROC_RCVLIST_ALL, 0644, can_dir,
 					   &can_rcvlist_proc_fops, (void *)RX_ALL);
-	pde_rcvlist_fil = proc_create_data(CAN_PROC_RCVLIST_FIL, 0644, can_dir,
-					   &can_rcvlist_proc_fops, (void *)RX_FIL);
+	pde_rcvlist_fil = proc_create(CAN_PROC_RCVLIST_FIL, 0644, can_dir,
+				      &can_rcvlist_fil_proc_fops);
 	pde_rcvlist_inv = proc_create_data(CAN_PROC_RCVLIST_INV, 0644, can_dir,
 					   &can_rcvlist_proc_fops, (void *)RX_INV);
-	pde_rcvlist_eff = proc_create_data(CAN_PROC_RCVLIST_EFF, 0644, can_dir,
-					   &can_rcvlist_proc_fops, (void *)RX_EFF);
+	pde_rcvlist_eff = proc_create(CAN_PROC_RCVLIST_EFF, 0644, can_dir,
+				      &can_rcvlist_eff_proc_fops);
 	pde_rcvlist_sff = proc_create(CAN_PROC_RCVLIST_SFF, 0644, can_dir,
 				      &can_rcvlist_sff_proc_fops);
 #else
@@ -758,11 +1078,11 @@ void can_init_proc(void)
 	pde_rcvlist_all = can_create_proc_readentry(CAN_PROC_RCVLIST_ALL, 0644,
 					can_proc_read_rcvlist, (void *)RX_ALL);
 	pde_rcvlist_fil = can_create_proc_readentry(CAN_PROC_RCVLIST_FIL, 0644,
-					can_proc_read_rcvlist, (void *)RX_FIL);
+					can_proc_read_rcvlist_fil, NULL);
 	pde_rcvlist_inv = can_create_proc_readentry(CAN_PROC_RCVLIST_INV, 0644,
 					can_proc_read_rcvlist, (void *)RX_INV);
 	pde_rcvlist_eff = can_create_proc_readentry(CAN_PROC_RCVLIST_EFF, 0644,
-					can_proc_read_rcvlist, (void *)RX_EFF);
+					can_proc_read_rcvlist_eff, NULL);
 	pde_rcvlist_sff = can_create_proc_readentry(CAN_PROC_RCVLIST_SFF, 0644,
 					can_proc_read_rcvlist_sff, NULL);
 #endif
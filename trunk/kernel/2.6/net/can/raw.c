@@ -50,6 +50,14 @@
 #include <linux/socket.h>
 #include <linux/if_arp.h>
 #include <linux/skbuff.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
 #include <socketcan/can.h>
 #include <socketcan/can/core.h>
 #include <socketcan/can/raw.h>
@@ -75,6 +83,10 @@ MODULE_ALIAS("can-proto-1");
 
 #define MASK_ALL 0
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
+#define sk_sleep(sk) ((sk)->sk_sleep)
+#endif
+
 /*
  * A raw socket has a list of can_filters attached to it, each receiving
  * the CAN frames matching that filter.  If the filter list is empty,
@@ -96,12 +108,53 @@ struct raw_sock {
 	struct notifier_block notifier;
 	int loopback;
 	int recv_own_msgs;
+	int recv_batch;            /* max. frames per raw_recvmsg() */
+	int send_batch;            /* frame array type in raw_sendmsg() */
 	int count;                 /* number of active filters */
 	struct can_filter dfilter; /* default/single filter */
 	struct can_filter *filter; /* pointer to filter(s) */
 	can_err_mask_t err_mask;
+	spinlock_t ring_lock;      /* protects the rx ring content */
+	struct can_raw_ring_slot *ring; /* mmap'able rx ring (vmalloc) */
+	unsigned int ring_nr;      /* number of slots in the rx ring */
+	unsigned int ring_head;    /* next slot to be filled */
+	unsigned int ring_drops;   /* frames dropped due to a full rx ring */
+	atomic_t ring_mapped;      /* number of mmap()s of the rx ring */
+	int fanout;                /* requested shared rx ring size */
+	struct raw_fanout *fo;     /* shared rx ring (fan-out group) */
+	struct list_head fo_list;  /* entry in the fan-out group socks list */
+	unsigned int fo_tail;      /* read position in the shared rx ring */
 };
 
+/*
+ * Sockets with identical filters, error mask, binding and ring size can
+ * share one rx ring (CAN_RAW_FANOUT).  The fan-out group registers the
+ * filters once at the CAN core and stores each received CAN frame once
+ * into the ring.  An additional socket only costs a wakeup and a copy from
+ * the ring at its own read position instead of a skb_clone() per frame.
+ */
+struct raw_fanout_entry {
+	struct can_raw_batch_frame bf;
+	struct sock *origin;       /* sending socket (only compared) */
+};
+
+struct raw_fanout {
+	struct list_head list;     /* entry in raw_fanout_list */
+	struct list_head socks;    /* attached sockets (RCU) */
+	int users;                 /* number of attached sockets */
+	struct net_device *dev;    /* registered device or NULL for all */
+	int count;                 /* number of filters */
+	struct can_filter *filter; /* copy of the filters */
+	can_err_mask_t err_mask;
+	spinlock_t lock;           /* protects head and the ring content */
+	unsigned int size;         /* number of ring entries (power of two) */
+	unsigned int head;         /* free running write position */
+	struct raw_fanout_entry *ring;
+};
+
+static LIST_HEAD(raw_fanout_list);
+static DEFINE_MUTEX(raw_fanout_mutex);
+
 /*
  * Return pointer to store the extra msg flags for raw_recvmsg().
  * We use the space of one unsigned int beyond the 'struct sockaddr_can'
@@ -125,6 +178,495 @@ static inline struct raw_sock *raw_sk(const struct sock *sk)
 #endif
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,18)
+/*
+ * raw_ring_rcv - put the received CAN frame into the mmap'able rx ring
+ *
+ * Return:
+ *  0 when no rx ring is set up (=> use the socket receive queue)
+ *  1 when the frame has been consumed by the rx ring
+ */
+static int raw_ring_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_ring_slot *slot;
+	struct timeval tv;
+
+	if (!ro->ring)
+		return 0;
+
+	spin_lock(&ro->ring_lock);
+
+	/* rx ring may have been removed in the meantime */
+	if (!ro->ring) {
+		spin_unlock(&ro->ring_lock);
+		return 0;
+	}
+
+	slot = &ro->ring[ro->ring_head];
+
+	if (slot->status != CAN_RAW_SLOT_KERNEL) {
+		/* rx ring is full */
+		ro->ring_drops++;
+		spin_unlock(&ro->ring_lock);
+		return 1;
+	}
+
+	/* read the slot status before writing the slot content */
+	smp_rmb();
+
+	skb_get_timestamp(skb, &tv);
+	if (!tv.tv_sec && !tv.tv_usec)
+		do_gettimeofday(&tv);
+
+	slot->drops      = ro->ring_drops;
+	slot->bf.tv_sec  = tv.tv_sec;
+	slot->bf.tv_usec = tv.tv_usec;
+	slot->bf.ifindex = skb->dev->ifindex;
+	slot->bf.flags   = 0;
+	if (skb->sk)
+		slot->bf.flags |= MSG_DONTROUTE;
+	if (skb->sk == sk)
+		slot->bf.flags |= MSG_CONFIRM;
+	memcpy(&slot->bf.frame, skb->data, sizeof(struct can_frame));
+
+	/* hand over the completely filled slot to the user */
+	smp_wmb();
+	slot->status = CAN_RAW_SLOT_USER;
+
+	if (++ro->ring_head >= ro->ring_nr)
+		ro->ring_head = 0;
+
+	spin_unlock(&ro->ring_lock);
+
+	sk->sk_data_ready(sk, sizeof(struct can_frame));
+
+	return 1;
+}
+
+/*
+ * raw_set_ring - set up, resize or remove (slot_nr = 0) the rx ring
+ *
+ * Must be called with the socket lock held.
+ */
+static int raw_set_ring(struct sock *sk, unsigned int slot_nr, int closing)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_ring_slot *ring = NULL;
+	struct can_raw_ring_slot *old;
+
+	if (!closing && atomic_read(&ro->ring_mapped))
+		return -EBUSY;
+
+	if (slot_nr > INT_MAX / sizeof(*ring))
+		return -EINVAL;
+
+	if (slot_nr) {
+		/* zeroed memory => all slots in CAN_RAW_SLOT_KERNEL state */
+		ring = vmalloc_user(PAGE_ALIGN(slot_nr * sizeof(*ring)));
+		if (!ring)
+			return -ENOMEM;
+	}
+
+	spin_lock_bh(&ro->ring_lock);
+	old = ro->ring;
+	ro->ring      = ring;
+	ro->ring_nr   = slot_nr;
+	ro->ring_head = 0;
+	spin_unlock_bh(&ro->ring_lock);
+
+	/* raw_ring_rcv() does not access the old ring outside the lock */
+	vfree(old);
+
+	return 0;
+}
+
+static void raw_mm_open(struct vm_area_struct *vma)
+{
+	struct socket *sock = vma->vm_file->private_data;
+	struct sock *sk = sock->sk;
+
+	if (sk)
+		atomic_inc(&raw_sk(sk)->ring_mapped);
+}
+
+static void raw_mm_close(struct vm_area_struct *vma)
+{
+	struct socket *sock = vma->vm_file->private_data;
+	struct sock *sk = sock->sk;
+
+	if (sk)
+		atomic_dec(&raw_sk(sk)->ring_mapped);
+}
+
+static struct vm_operations_struct raw_mmap_ops = {
+	.open  = raw_mm_open,
+	.close = raw_mm_close,
+};
+
+static int raw_mmap(struct file *file, struct socket *sock,
+		    struct vm_area_struct *vma)
+{
+	struct sock *sk = sock->sk;
+	struct raw_sock *ro = raw_sk(sk);
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int err = -EINVAL;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	lock_sock(sk);
+
+	if (!ro->ring ||
+	    size != PAGE_ALIGN(ro->ring_nr * sizeof(struct can_raw_ring_slot)))
+		goto out;
+
+	err = remap_vmalloc_range(vma, ro->ring, 0);
+	if (err)
+		goto out;
+
+	vma->vm_ops = &raw_mmap_ops;
+	atomic_inc(&ro->ring_mapped);
+
+ out:
+	release_sock(sk);
+
+	return err;
+}
+
+/* the latest filled slot of the rx ring has not been consumed yet */
+static int raw_ring_pending(struct raw_sock *ro)
+{
+	unsigned int last;
+	int pending = 0;
+
+	spin_lock_bh(&ro->ring_lock);
+	if (ro->ring) {
+		last = ro->ring_head ? ro->ring_head - 1 : ro->ring_nr - 1;
+		pending = (ro->ring[last].status != CAN_RAW_SLOT_KERNEL);
+	}
+	spin_unlock_bh(&ro->ring_lock);
+
+	return pending;
+}
+#else
+static inline int raw_ring_rcv(struct sock *sk, struct sk_buff *skb)
+{
+	return 0;
+}
+
+static inline int raw_set_ring(struct sock *sk, unsigned int slot_nr,
+			       int closing)
+{
+	return slot_nr ? -ENOPROTOOPT : 0;
+}
+
+static inline int raw_ring_pending(struct raw_sock *ro)
+{
+	return 0;
+}
+
+#define raw_mmap sock_no_mmap
+#endif
+
+static void raw_fanout_rcv(struct sk_buff *skb, void *data)
+{
+	struct raw_fanout *fo = (struct raw_fanout *)data;
+	struct raw_fanout_entry *e;
+	struct raw_sock *ro;
+	struct sock *sk;
+	struct timeval tv;
+
+	skb_get_timestamp(skb, &tv);
+	if (!tv.tv_sec && !tv.tv_usec)
+		do_gettimeofday(&tv);
+
+	spin_lock(&fo->lock);
+
+	e = &fo->ring[fo->head & (fo->size - 1)];
+	e->origin     = skb->sk;
+	e->bf.tv_sec  = tv.tv_sec;
+	e->bf.tv_usec = tv.tv_usec;
+	e->bf.ifindex = skb->dev->ifindex;
+	e->bf.flags   = skb->sk ? MSG_DONTROUTE : 0;
+	memcpy(&e->bf.frame, skb->data, sizeof(struct can_frame));
+	fo->head++;
+
+	spin_unlock(&fo->lock);
+
+	/* called from can_rcv() under rcu_read_lock() */
+	list_for_each_entry_rcu(ro, &fo->socks, fo_list) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,12)
+		sk = &ro->sk;
+#else
+		sk = ro->sk;
+#endif
+		if (!ro->recv_own_msgs && skb->sk == sk)
+			continue;
+
+		sk->sk_data_ready(sk, sizeof(struct can_frame));
+	}
+}
+
+static void raw_fanout_unregister(struct raw_fanout *fo, int count)
+{
+	while (--count >= 0)
+		can_rx_unregister(fo->dev, fo->filter[count].can_id,
+				  fo->filter[count].can_mask,
+				  raw_fanout_rcv, fo);
+}
+
+static void raw_fanout_free(struct raw_fanout *fo)
+{
+	vfree(fo->ring);
+	kfree(fo->filter);
+	kfree(fo);
+}
+
+/*
+ * raw_fanout_get - find or create the fan-out group for the given settings
+ *
+ * Must be called with raw_fanout_mutex held.
+ */
+static struct raw_fanout *raw_fanout_get(struct net_device *dev,
+					 struct can_filter *filter, int count,
+					 can_err_mask_t err_mask,
+					 unsigned int size)
+{
+	struct raw_fanout *fo;
+	int err = 0;
+	int i;
+
+	list_for_each_entry(fo, &raw_fanout_list, list) {
+		if (fo->dev == dev && fo->size == size &&
+		    fo->err_mask == err_mask && fo->count == count &&
+		    !memcmp(fo->filter, filter, count * sizeof(*filter))) {
+			fo->users++;
+			return fo;
+		}
+	}
+
+	fo = kzalloc(sizeof(*fo), GFP_KERNEL);
+	if (!fo)
+		return ERR_PTR(-ENOMEM);
+
+	if (count) {
+		fo->filter = kmalloc(count * sizeof(*filter), GFP_KERNEL);
+		if (!fo->filter) {
+			kfree(fo);
+			return ERR_PTR(-ENOMEM);
+		}
+		memcpy(fo->filter, filter, count * sizeof(*filter));
+	}
+
+	fo->ring = vmalloc(size * sizeof(*fo->ring));
+	if (!fo->ring) {
+		raw_fanout_free(fo);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	INIT_LIST_HEAD(&fo->socks);
+	spin_lock_init(&fo->lock);
+	fo->count    = count;
+	fo->err_mask = err_mask;
+	fo->dev      = dev;
+	fo->size     = size;
+	fo->users    = 1;
+
+	for (i = 0; i < count; i++) {
+		err = can_rx_register(dev, filter[i].can_id,
+				      filter[i].can_mask,
+				      raw_fanout_rcv, fo, "raw-fanout");
+		if (err)
+			break;
+	}
+
+	if (!err && err_mask)
+		err = can_rx_register(dev, 0, err_mask | CAN_ERR_FLAG,
+				      raw_fanout_rcv, fo, "raw-fanout");
+
+	if (err) {
+		/* clean up successfully registered filters */
+		raw_fanout_unregister(fo, i);
+		synchronize_rcu();
+		raw_fanout_free(fo);
+		return ERR_PTR(err);
+	}
+
+	list_add(&fo->list, &raw_fanout_list);
+
+	return fo;
+}
+
+/*
+ * raw_fanout_set - attach the socket to the fan-out group matching the
+ * given settings or just detach it from its current group (join = 0)
+ *
+ * Must be called with the socket lock held.
+ */
+static int raw_fanout_set(struct net_device *dev, struct sock *sk,
+			  struct can_filter *filter, int count,
+			  can_err_mask_t err_mask, int join)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct raw_fanout *prev = ro->fo;
+	struct raw_fanout *fo = NULL;
+	int release = 0;
+	unsigned int size;
+
+	mutex_lock(&raw_fanout_mutex);
+
+	if (join) {
+		for (size = 1; size < ro->fanout; size <<= 1)
+			;
+
+		fo = raw_fanout_get(dev, filter, count, err_mask, size);
+		if (IS_ERR(fo)) {
+			mutex_unlock(&raw_fanout_mutex);
+			return PTR_ERR(fo);
+		}
+	}
+
+	if (prev) {
+		list_del_rcu(&ro->fo_list);
+		rcu_assign_pointer(ro->fo, NULL);
+
+		if (!--prev->users) {
+			release = 1;
+			if (prev->err_mask)
+				can_rx_unregister(prev->dev, 0,
+						  prev->err_mask | CAN_ERR_FLAG,
+						  raw_fanout_rcv, prev);
+			raw_fanout_unregister(prev, prev->count);
+			list_del(&prev->list);
+		}
+	}
+
+	mutex_unlock(&raw_fanout_mutex);
+
+	if (prev) {
+		/* wait for raw_fanout_rcv() walking the old socks list */
+		synchronize_rcu();
+
+		if (release)
+			raw_fanout_free(prev);
+	}
+
+	if (fo) {
+		mutex_lock(&raw_fanout_mutex);
+
+		/* start reading with the next received frame */
+		spin_lock_bh(&fo->lock);
+		ro->fo_tail = fo->head;
+		spin_unlock_bh(&fo->lock);
+
+		list_add_tail_rcu(&ro->fo_list, &fo->socks);
+		rcu_assign_pointer(ro->fo, fo);
+
+		mutex_unlock(&raw_fanout_mutex);
+	}
+
+	return 0;
+}
+
+static int raw_fanout_pending(struct sock *sk)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct raw_fanout *fo;
+	unsigned int tail;
+	int pending = 0;
+
+	rcu_read_lock();
+	fo = rcu_dereference(ro->fo);
+	if (fo) {
+		spin_lock_bh(&fo->lock);
+
+		/* overwritten entries are skipped by raw_fanout_fetch() */
+		tail = ro->fo_tail;
+		if (fo->head - tail > fo->size)
+			tail = fo->head - fo->size;
+
+		/* own frames are only pending with recv_own_msgs enabled */
+		for (; tail != fo->head; tail++) {
+			if (ro->recv_own_msgs ||
+			    fo->ring[tail & (fo->size - 1)].origin != sk) {
+				pending = 1;
+				break;
+			}
+		}
+
+		spin_unlock_bh(&fo->lock);
+	}
+	rcu_read_unlock();
+
+	return pending;
+}
+
+/*
+ * raw_fanout_fetch - copy the next frame from the shared rx ring
+ *
+ * Must be called with the socket lock held. The read position is left at
+ * the returned frame. The caller removes it from the ring by incrementing
+ * ro->fo_tail after it has been copied to the user successfully.
+ * Return: 1 when a frame has been copied to bf, 0 otherwise.
+ */
+static int raw_fanout_fetch(struct sock *sk, struct can_raw_batch_frame *bf)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct raw_fanout *fo = ro->fo;
+	struct raw_fanout_entry *e;
+	unsigned int lost;
+	int ret = 0;
+
+	if (!fo)
+		return 0;
+
+	spin_lock_bh(&fo->lock);
+
+	/* skip the entries that have been overwritten in the meantime */
+	lost = fo->head - ro->fo_tail;
+	if (lost > fo->size) {
+		lost -= fo->size;
+		ro->fo_tail += lost;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,33)
+		atomic_add(lost, &sk->sk_drops);
+#endif
+	}
+
+	while (ro->fo_tail != fo->head) {
+		e = &fo->ring[ro->fo_tail & (fo->size - 1)];
+
+		/* check the received tx sock reference */
+		if (e->origin == sk && !ro->recv_own_msgs) {
+			ro->fo_tail++;
+			continue;
+		}
+
+		*bf = e->bf;
+		if (e->origin == sk)
+			bf->flags |= MSG_CONFIRM;
+
+		ret = 1;
+		break;
+	}
+
+	spin_unlock_bh(&fo->lock);
+
+	return ret;
+}
+
+static unsigned int raw_poll(struct file *file, struct socket *sock,
+			     poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	unsigned int mask = datagram_poll(file, sock, wait);
+
+	if (raw_ring_pending(raw_sk(sk)) || raw_fanout_pending(sk))
+		mask |= POLLIN | POLLRDNORM;
+
+	return mask;
+}
+
 static void raw_rcv(struct sk_buff *oskb, void *data)
 {
 	struct sock *sk = (struct sock *)data;
@@ -137,6 +679,10 @@ static void raw_rcv(struct sk_buff *oskb, void *data)
 	if (!ro->recv_own_msgs && oskb->sk == sk)
 		return;
 
+	/* no skb_clone() needed when the frame is put into the rx ring */
+	if (raw_ring_rcv(sk, oskb))
+		return;
+
 	/* clone the given skb to be able to enqueue it into the rcv queue */
 	skb = skb_clone(oskb, GFP_ATOMIC);
 	if (!skb)
@@ -227,6 +773,11 @@ static inline void raw_disable_allfilters(struct net_device *dev,
 {
 	struct raw_sock *ro = raw_sk(sk);
 
+	if (ro->fanout) {
+		raw_fanout_set(dev, sk, NULL, 0, 0, 0);
+		return;
+	}
+
 	raw_disable_filters(dev, sk, ro->filter, ro->count);
 	raw_disable_errfilter(dev, sk, ro->err_mask);
 }
@@ -236,6 +787,11 @@ static int raw_enable_allfilters(struct net_device *dev, struct sock *sk)
 	struct raw_sock *ro = raw_sk(sk);
 	int err;
 
+	/* replaces the registration of a previous binding */
+	if (ro->fanout)
+		return raw_fanout_set(dev, sk, ro->filter, ro->count,
+				      ro->err_mask, 1);
+
 	err = raw_enable_filters(dev, sk, ro->filter, ro->count);
 	if (!err) {
 		err = raw_enable_errfilter(dev, sk, ro->err_mask);
@@ -321,6 +877,22 @@ static int raw_init(struct sock *sk)
 	/* set default loopback behaviour */
 	ro->loopback         = 1;
 	ro->recv_own_msgs    = 0;
+	ro->recv_batch       = 0;
+	ro->send_batch       = 0;
+
+	/* no rx ring */
+	spin_lock_init(&ro->ring_lock);
+	ro->ring             = NULL;
+	ro->ring_nr          = 0;
+	ro->ring_head        = 0;
+	ro->ring_drops       = 0;
+	atomic_set(&ro->ring_mapped, 0);
+
+	/* no shared rx ring */
+	ro->fanout           = 0;
+	ro->fo               = NULL;
+	ro->fo_tail          = 0;
+	INIT_LIST_HEAD(&ro->fo_list);
 
 	/* set notifier */
 	ro->notifier.notifier_call = raw_notifier;
@@ -365,6 +937,9 @@ static int raw_release(struct socket *sock)
 	ro->bound   = 0;
 	ro->count   = 0;
 
+	/* mapped pages are kept by the mm until munmap() */
+	raw_set_ring(sk, 0, 1);
+
 	sock_orphan(sk);
 	sock->sk = NULL;
 
@@ -420,7 +995,8 @@ static int raw_bind(struct socket *sock, struct sockaddr *uaddr, int len)
 	}
 
 	if (!err) {
-		if (ro->bound) {
+		/* a fan-out group has already been replaced above */
+		if (ro->bound && !ro->fanout) {
 			/* unregister old filters */
 			if (ro->ifindex) {
 				struct net_device *dev;
@@ -481,6 +1057,7 @@ static int raw_setsockopt(struct socket *sock, int level, int optname,
 	struct can_filter sfilter;         /* single filter */
 	struct net_device *dev = NULL;
 	can_err_mask_t err_mask = 0;
+	struct can_raw_ring_req ring_req;
 	int count = 0;
 	int err = 0;
 
@@ -517,7 +1094,20 @@ static int raw_setsockopt(struct socket *sock, int level, int optname,
 		if (ro->bound && ro->ifindex)
 			dev = dev_get_by_index(&init_net, ro->ifindex);
 
-		if (ro->bound) {
+		if (ro->bound && ro->fanout) {
+			/* (try to) switch to the new fan-out group */
+			if (count == 1)
+				err = raw_fanout_set(dev, sk, &sfilter, 1,
+						     ro->err_mask, 1);
+			else
+				err = raw_fanout_set(dev, sk, filter, count,
+						     ro->err_mask, 1);
+			if (err) {
+				if (count > 1)
+					kfree(filter);
+				goto out_fil;
+			}
+		} else if (ro->bound) {
 			/* (try to) register the new filters */
 			if (count == 1)
 				err = raw_enable_filters(dev, sk, &sfilter, 1);
@@ -570,7 +1160,13 @@ static int raw_setsockopt(struct socket *sock, int level, int optname,
 			dev = dev_get_by_index(&init_net, ro->ifindex);
 
 		/* remove current error mask */
-		if (ro->bound) {
+		if (ro->bound && ro->fanout) {
+			/* (try to) switch to the new fan-out group */
+			err = raw_fanout_set(dev, sk, ro->filter, ro->count,
+					     err_mask, 1);
+			if (err)
+				goto out_err;
+		} else if (ro->bound) {
 			/* (try to) register the new err_mask */
 			err = raw_enable_errfilter(dev, sk, err_mask);
 
@@ -610,6 +1206,71 @@ static int raw_setsockopt(struct socket *sock, int level, int optname,
 
 		break;
 
+	case CAN_RAW_RECV_BATCH:
+		if (optlen != sizeof(count))
+			return -EINVAL;
+
+		if (copy_from_user(&count, optval, optlen))
+			return -EFAULT;
+
+		if (count < 0)
+			return -EINVAL;
+
+		ro->recv_batch = count;
+
+		break;
+
+	case CAN_RAW_SEND_BATCH:
+		if (optlen != sizeof(count))
+			return -EINVAL;
+
+		if (copy_from_user(&count, optval, optlen))
+			return -EFAULT;
+
+		if (count && count != CAN_RAW_BATCH_FRAMES &&
+		    count != CAN_RAW_BATCH_IFFRAMES)
+			return -EINVAL;
+
+		ro->send_batch = count;
+
+		break;
+
+	case CAN_RAW_RX_RING:
+		if (optlen != sizeof(ring_req))
+			return -EINVAL;
+
+		if (copy_from_user(&ring_req, optval, optlen))
+			return -EFAULT;
+
+		lock_sock(sk);
+		if (ro->fanout && ring_req.slot_nr)
+			err = -EBUSY;
+		else
+			err = raw_set_ring(sk, ring_req.slot_nr, 0);
+		release_sock(sk);
+
+		break;
+
+	case CAN_RAW_FANOUT:
+		if (optlen != sizeof(count))
+			return -EINVAL;
+
+		if (copy_from_user(&count, optval, optlen))
+			return -EFAULT;
+
+		if (count < 0 || count > CAN_RAW_FANOUT_MAX)
+			return -EINVAL;
+
+		lock_sock(sk);
+		/* the filter registration depends on the fan-out mode */
+		if (ro->bound || ro->ring)
+			err = -EBUSY;
+		else
+			ro->fanout = count;
+		release_sock(sk);
+
+		break;
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -621,6 +1282,7 @@ static int raw_getsockopt(struct socket *sock, int level, int optname,
 {
 	struct sock *sk = sock->sk;
 	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_ring_req ring_req;
 	int len;
 	void *val;
 	int err = 0;
@@ -668,6 +1330,34 @@ static int raw_getsockopt(struct socket *sock, int level, int optname,
 		val = &ro->recv_own_msgs;
 		break;
 
+	case CAN_RAW_RECV_BATCH:
+		if (len > sizeof(int))
+			len = sizeof(int);
+		val = &ro->recv_batch;
+		break;
+
+	case CAN_RAW_SEND_BATCH:
+		if (len > sizeof(int))
+			len = sizeof(int);
+		val = &ro->send_batch;
+		break;
+
+	case CAN_RAW_RX_RING:
+		if (len > sizeof(ring_req))
+			len = sizeof(ring_req);
+		spin_lock_bh(&ro->ring_lock);
+		ring_req.slot_nr = ro->ring_nr;
+		ring_req.drops   = ro->ring_drops;
+		spin_unlock_bh(&ro->ring_lock);
+		val = &ring_req;
+		break;
+
+	case CAN_RAW_FANOUT:
+		if (len > sizeof(int))
+			len = sizeof(int);
+		val = &ro->fanout;
+		break;
+
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -679,6 +1369,80 @@ static int raw_getsockopt(struct socket *sock, int level, int optname,
 	return 0;
 }
 
+/*
+ * raw_sendmsg_batch - send an array of CAN frames with one raw_sendmsg()
+ *
+ * The netdevice is only looked up again when the interface index changes
+ * between two frames. On errors the number of bytes of the successfully
+ * sent frames is returned (if any).
+ */
+static int raw_sendmsg_batch(struct sock *sk, struct msghdr *msg,
+			     size_t size, int ifindex)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_batch_frame bf;
+	struct net_device *dev = NULL;
+	struct sk_buff *skb;
+	size_t esize, sent;
+	int err = 0;
+
+	if (ro->send_batch == CAN_RAW_BATCH_IFFRAMES)
+		esize = sizeof(bf);
+	else
+		esize = sizeof(struct can_frame);
+
+	if (!size || size % esize)
+		return -EINVAL;
+
+	bf.ifindex = ifindex;
+
+	for (sent = 0; sent < size; sent += esize) {
+		if (esize == sizeof(bf)) {
+			err = memcpy_fromiovec((unsigned char *)&bf,
+					       msg->msg_iov, esize);
+			if (!bf.ifindex)
+				bf.ifindex = ifindex;
+		} else
+			err = memcpy_fromiovec((unsigned char *)&bf.frame,
+					       msg->msg_iov, esize);
+		if (err < 0)
+			break;
+
+		if (!dev || dev->ifindex != bf.ifindex) {
+			if (dev)
+				dev_put(dev);
+
+			dev = dev_get_by_index(&init_net, bf.ifindex);
+			if (!dev) {
+				err = -ENXIO;
+				break;
+			}
+		}
+
+		skb = sock_alloc_send_skb(sk, sizeof(struct can_frame),
+					  msg->msg_flags & MSG_DONTWAIT, &err);
+		if (!skb)
+			break;
+
+		memcpy(skb_put(skb, sizeof(struct can_frame)), &bf.frame,
+		       sizeof(struct can_frame));
+		skb->dev = dev;
+		skb->sk  = sk;
+
+		err = can_send(skb, ro->loopback);
+		if (err)
+			break;
+	}
+
+	if (dev)
+		dev_put(dev);
+
+	if (sent)
+		return sent;
+
+	return err;
+}
+
 static int raw_sendmsg(struct kiocb *iocb, struct socket *sock,
 		       struct msghdr *msg, size_t size)
 {
@@ -703,6 +1467,9 @@ static int raw_sendmsg(struct kiocb *iocb, struct socket *sock,
 	} else
 		ifindex = ro->ifindex;
 
+	if (ro->send_batch)
+		return raw_sendmsg_batch(sk, msg, size, ifindex);
+
 	if (size != sizeof(struct can_frame))
 		return -EINVAL;
 
@@ -738,6 +1505,179 @@ send_failed:
 	return err;
 }
 
+/*
+ * raw_recvmsg_batch - copy up to recv_batch CAN frames into the user buffer
+ *
+ * The first frame is received with the blocking semantics of the socket.
+ * Further frames are only taken when they are already in the receive queue.
+ */
+static int raw_recvmsg_batch(struct sock *sk, struct msghdr *msg,
+			     size_t size, int flags, int noblock)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_batch_frame bf;
+	struct sk_buff *skb;
+	struct timeval tv;
+	int max = ro->recv_batch;
+	int count = 0;
+	int err = 0;
+
+	if (size < sizeof(bf))
+		return -EINVAL;
+
+	if (max > size / sizeof(bf))
+		max = size / sizeof(bf);
+
+	/* MSG_PEEK would return the same skb again and again */
+	if (flags & MSG_PEEK)
+		max = 1;
+
+	while (count < max) {
+		skb = skb_recv_datagram(sk, flags, count ? 1 : noblock, &err);
+		if (!skb)
+			break;
+
+		if (!count) {
+			/* use the first frame for timestamp & address */
+			sock_recv_timestamp(msg, sk, skb);
+
+			if (msg->msg_name) {
+				msg->msg_namelen = sizeof(struct sockaddr_can);
+				memcpy(msg->msg_name, skb->cb,
+				       msg->msg_namelen);
+			}
+		}
+
+		skb_get_timestamp(skb, &tv);
+		bf.tv_sec  = tv.tv_sec;
+		bf.tv_usec = tv.tv_usec;
+		bf.ifindex = ((struct sockaddr_can *)skb->cb)->can_ifindex;
+		bf.flags   = *(raw_flags(skb));
+		memcpy(&bf.frame, skb->data, sizeof(bf.frame));
+
+		err = memcpy_toiovec(msg->msg_iov, (unsigned char *)&bf,
+				     sizeof(bf));
+		if (err < 0) {
+			/* keep the frame that could not be copied */
+			if (!(flags & MSG_PEEK))
+				skb_queue_head(&sk->sk_receive_queue, skb);
+			else
+				skb_free_datagram(sk, skb);
+			break;
+		}
+
+		skb_free_datagram(sk, skb);
+		count++;
+	}
+
+	/* return the frames that have already been copied */
+	if (count)
+		return count * sizeof(bf);
+
+	return err;
+}
+
+/*
+ * raw_recvmsg_fanout - read CAN frames from the shared rx ring
+ *
+ * Returns a single struct can_frame or (with CAN_RAW_RECV_BATCH) an array
+ * of struct can_raw_batch_frame like the receive queue based functions.
+ */
+static int raw_recvmsg_fanout(struct sock *sk, struct msghdr *msg,
+			      size_t size, int flags, int noblock)
+{
+	struct raw_sock *ro = raw_sk(sk);
+	struct can_raw_batch_frame bf;
+	struct sockaddr_can *addr;
+	struct timeval tv;
+	long timeo = sock_rcvtimeo(sk, noblock);
+	int max = 1;
+	int count = 0;
+	int err = 0;
+
+	/* the frames are removed from the ring on reading */
+	if (flags & MSG_PEEK)
+		return -EOPNOTSUPP;
+
+	if (ro->recv_batch) {
+		if (size < sizeof(bf))
+			return -EINVAL;
+
+		max = ro->recv_batch;
+		if (max > size / sizeof(bf))
+			max = size / sizeof(bf);
+	}
+
+	for (;;) {
+		lock_sock(sk);
+
+		while (count < max && raw_fanout_fetch(sk, &bf)) {
+
+			if (!count) {
+				/* first frame provides timestamp & address */
+				if (sock_flag(sk, SOCK_RCVTSTAMP)) {
+					tv.tv_sec  = bf.tv_sec;
+					tv.tv_usec = bf.tv_usec;
+					put_cmsg(msg, SOL_SOCKET, SO_TIMESTAMP,
+						 sizeof(tv), &tv);
+				}
+
+				if (msg->msg_name) {
+					addr = msg->msg_name;
+					memset(addr, 0, sizeof(*addr));
+					addr->can_family  = AF_CAN;
+					addr->can_ifindex = bf.ifindex;
+					msg->msg_namelen = sizeof(*addr);
+				}
+			}
+
+			if (ro->recv_batch) {
+				err = memcpy_toiovec(msg->msg_iov,
+						     (unsigned char *)&bf,
+						     sizeof(bf));
+			} else {
+				if (size < sizeof(bf.frame))
+					msg->msg_flags |= MSG_TRUNC;
+				else
+					size = sizeof(bf.frame);
+
+				err = memcpy_toiovec(msg->msg_iov,
+						     (unsigned char *)&bf.frame,
+						     size);
+				msg->msg_flags |= bf.flags;
+			}
+
+			if (err < 0)
+				break;
+
+			/* remove the copied frame from the ring */
+			ro->fo_tail++;
+			count++;
+		}
+
+		release_sock(sk);
+
+		/* return the frames that have already been copied */
+		if (count)
+			return ro->recv_batch ? count * sizeof(bf) : size;
+
+		if (err < 0)
+			return err;
+
+		err = sock_error(sk);
+		if (err)
+			return err;
+
+		if (!timeo)
+			return -EAGAIN;
+
+		timeo = wait_event_interruptible_timeout(*sk_sleep(sk),
+				raw_fanout_pending(sk) || sk->sk_err, timeo);
+		if (signal_pending(current))
+			return sock_intr_errno(timeo);
+	}
+}
+
 static int raw_recvmsg(struct kiocb *iocb, struct socket *sock,
 		       struct msghdr *msg, size_t size, int flags)
 {
@@ -749,6 +1689,12 @@ static int raw_recvmsg(struct kiocb *iocb, struct socket *sock,
 	noblock =  flags & MSG_DONTWAIT;
 	flags   &= ~MSG_DONTWAIT;
 
+	if (raw_sk(sk)->fanout)
+		return raw_recvmsg_fanout(sk, msg, size, flags, noblock);
+
+	if (raw_sk(sk)->recv_batch)
+		return raw_recvmsg_batch(sk, msg, size, flags, noblock);
+
 	skb = skb_recv_datagram(sk, flags, noblock, &err);
 	if (!skb)
 		return err;
@@ -787,7 +1733,7 @@ static const struct proto_ops raw_ops = {
 	.socketpair    = sock_no_socketpair,
 	.accept        = sock_no_accept,
 	.getname       = raw_getname,
-	.poll          = datagram_poll,
+	.poll          = raw_poll,
 	.ioctl         = can_ioctl,	/* use can_ioctl() from af_can.c */
 	.listen        = sock_no_listen,
 	.shutdown      = sock_no_shutdown,
@@ -795,7 +1741,7 @@ static const struct proto_ops raw_ops = {
 	.getsockopt    = raw_getsockopt,
 	.sendmsg       = raw_sendmsg,
 	.recvmsg       = raw_recvmsg,
-	.mmap          = sock_no_mmap,
+	.mmap          = raw_mmap,
 	.sendpage      = sock_no_sendpage,
 };
 
@@ -13,12 +13,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <net/if.h>
 
 #include <asm/types.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <socketcan/can/gw.h>
+#include <socketcan/can/raw.h>
 
 #include <linux/if_link.h>
 
@@ -44,9 +46,80 @@ int addattr_l(struct nlmsghdr *n, int maxlen, int type, const void *data,
 	return 0;
 }
 
+/*
+ * Send 'frames' CAN frames matching the gateway filter on the source
+ * interface and read them back from the destination interface to measure
+ * the throughput of the gateway job including the frame modifications.
+ */
+int bench(int src, int dst, int frames)
+{
+	struct sockaddr_can addr;
+	struct can_frame frame;
+	struct timeval start, end;
+	int tx, rx;
+	int i;
+	double usecs;
+
+	tx = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	rx = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	if (tx < 0 || rx < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = src;
+	if (bind(tx, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	addr.can_ifindex = dst;
+	if (bind(rx, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	frame.can_id = 0x423;
+	frame.can_dlc = 8;
+	*(unsigned long long *)frame.data = 0x1122334455667788ULL;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < frames; i++) {
+		frame.data[0] = i;
+		if (write(tx, &frame, sizeof(frame)) != sizeof(frame)) {
+			perror("write");
+			return 1;
+		}
+		if (read(rx, &frame, sizeof(frame)) != sizeof(frame)) {
+			perror("read");
+			return 1;
+		}
+	}
+
+	gettimeofday(&end, NULL);
+
+	usecs = (end.tv_sec - start.tv_sec) * 1000000.0 +
+		(end.tv_usec - start.tv_usec);
+
+	printf("%d frames in %.0f usecs (%.2f usecs/frame, %.0f frames/s)\n",
+	       frames, usecs, usecs / frames, frames * 1000000.0 / usecs);
+	printf("last frame %03X [%d] %016llX\n", frame.can_id, frame.can_dlc,
+	       *(unsigned long long *)frame.data);
+
+	close(tx);
+	close(rx);
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	int s;
+	int opt;
+	int frames = 0;
+	int plain = 0;
 
 	struct {
 		struct nlmsghdr n;
@@ -63,6 +136,26 @@ int main(int argc, char **argv)
 	u_int32_t src = if_nametoindex("vcan2");
 	u_int32_t dst = if_nametoindex("vcan3");
 
+	while ((opt = getopt(argc, argv, "n:p")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'p':
+			plain = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n <frames>] [-p]\n",
+				argv[0]);
+			fprintf(stderr, "Adds a modifying gateway job vcan2 -> vcan3 "
+				"and optionally\nmeasures its throughput with "
+				"<frames> CAN frames.\n");
+			fprintf(stderr, "-p adds a plain job without modifications "
+				"and echo (forwarding fast path).\n");
+			return 1;
+		}
+	}
+
 	s = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
 
 	memset(&req, 0, sizeof(req));
@@ -74,7 +167,7 @@ int main(int argc, char **argv)
 
 	req.r.can_family  = AF_CAN;
 	req.r.gwtype = CGW_TYPE_CAN_CAN;
-	req.r.flags = CGW_FLAGS_CAN_ECHO;
+	req.r.flags = plain ? 0 : CGW_FLAGS_CAN_ECHO;
 
 	addattr_l(&req.n, sizeof(req), CGW_SRC_IF, &src, sizeof(src));
 	addattr_l(&req.n, sizeof(req), CGW_DST_IF, &dst, sizeof(dst));
@@ -91,18 +184,24 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	modmsg.cf.can_id  = 0x555;
-	modmsg.cf.can_dlc = 5;
-	*(unsigned long long *)modmsg.cf.data = 0x5555555555555555ULL;
+	/* no modifications for the plain forwarding job */
+	if (!plain) {
+		modmsg.cf.can_id  = 0x555;
+		modmsg.cf.can_dlc = 5;
+		*(unsigned long long *)modmsg.cf.data = 0x5555555555555555ULL;
 
-	modmsg.modtype = CGW_MOD_ID;
-	addattr_l(&req.n, sizeof(req), CGW_MOD_SET, &modmsg, CGW_MODATTR_LEN);
+		modmsg.modtype = CGW_MOD_ID;
+		addattr_l(&req.n, sizeof(req), CGW_MOD_SET, &modmsg,
+			  CGW_MODATTR_LEN);
 
-	modmsg.modtype = CGW_MOD_DLC;
-	addattr_l(&req.n, sizeof(req), CGW_MOD_AND, &modmsg, CGW_MODATTR_LEN);
+		modmsg.modtype = CGW_MOD_DLC;
+		addattr_l(&req.n, sizeof(req), CGW_MOD_AND, &modmsg,
+			  CGW_MODATTR_LEN);
 
-	modmsg.modtype = CGW_MOD_DATA;
-	addattr_l(&req.n, sizeof(req), CGW_MOD_XOR, &modmsg, CGW_MODATTR_LEN);
+		modmsg.modtype = CGW_MOD_DATA;
+		addattr_l(&req.n, sizeof(req), CGW_MOD_XOR, &modmsg,
+			  CGW_MODATTR_LEN);
+	}
 
 	memset(&nladdr, 0, sizeof(nladdr));
 	nladdr.nl_family = AF_NETLINK;
@@ -115,6 +214,9 @@ int main(int argc, char **argv)
 	perror("netlink says ");
 	close(s);
 
+	if (frames)
+		return bench(src, dst, frames);
+
 	return 0;
 }
 
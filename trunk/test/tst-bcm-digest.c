@@ -0,0 +1,189 @@
+/*
+ *  $Id$
+ */
+
+/*
+ * tst-bcm-digest.c
+ *
+ * Copyright (c) 2011 Volkswagen Group Electronic Research
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <socketcan-users@lists.berlios.de>
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <net/if.h>
+
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+#define U64_DATA(p) (*(unsigned long long*)(p)->data)
+#define BCM_1FRAME_LEN (sizeof(struct bcm_msg_head) + sizeof(struct can_frame))
+
+static void tx_send(int s, canid_t can_id, unsigned long long data)
+{
+	struct {
+		struct bcm_msg_head msg_head;
+		struct can_frame frame[1];
+	} txmsg;
+
+	memset(&txmsg, 0, sizeof(txmsg));
+	txmsg.msg_head.opcode  = TX_SEND;
+	txmsg.msg_head.nframes = 1;
+	txmsg.frame[0].can_id  = can_id;
+	txmsg.frame[0].can_dlc = 8;
+	U64_DATA(&txmsg.frame[0]) = data;
+
+	if (write(s, &txmsg, BCM_1FRAME_LEN) < 0)
+		perror("write");
+}
+
+int main(int argc, char **argv)
+{
+	int s, nbytes, i;
+	struct sockaddr_can addr;
+	struct ifreq ifr;
+	struct timeval ival;
+
+	struct {
+		struct bcm_msg_head msg_head;
+		struct can_frame frame[4];
+	} txmsg, rxmsg;
+
+	if ((s = socket(PF_CAN, SOCK_DGRAM, CAN_BCM)) < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	addr.can_family = PF_CAN;
+	strcpy(ifr.ifr_name, "vcan2");
+	ioctl(s, SIOCGIFINDEX, &ifr);
+	addr.can_ifindex = ifr.ifr_ifindex;
+
+	if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		return 1;
+	}
+
+	/* collect the content changes for 200ms */
+	ival.tv_sec = 0;
+	ival.tv_usec = 200000;
+
+	if (setsockopt(s, SOL_CAN_BCM, CAN_BCM_RX_DIGEST,
+		       &ival, sizeof(ival)) < 0) {
+		perror("setsockopt CAN_BCM_RX_DIGEST");
+		return 1;
+	}
+
+	memset(&txmsg, 0, sizeof(txmsg));
+	txmsg.msg_head.opcode  = RX_SETUP;
+	txmsg.msg_head.flags   = RX_FILTER_ID;
+	txmsg.msg_head.nframes = 0;
+
+	txmsg.msg_head.can_id  = 0x042;
+	printf("<*>Writing RX_SETUP with RX_FILTER_ID for can_id <%03X>\n",
+	       txmsg.msg_head.can_id);
+	if (write(s, &txmsg, sizeof(struct bcm_msg_head)) < 0)
+		perror("write");
+
+	txmsg.msg_head.can_id  = 0x043;
+	printf("<*>Writing RX_SETUP with RX_FILTER_ID for can_id <%03X>\n",
+	       txmsg.msg_head.can_id);
+	if (write(s, &txmsg, sizeof(struct bcm_msg_head)) < 0)
+		perror("write");
+
+	printf("<1>Writing TX_SEND for can_id <042> <043> <042>\n");
+	tx_send(s, 0x042, 0x1111111111111111ULL);
+	tx_send(s, 0x043, 0x2222222222222222ULL);
+	tx_send(s, 0x042, 0x3333333333333333ULL);
+
+	if ((nbytes = read(s, &rxmsg, sizeof(rxmsg))) < 0)
+		perror("read");
+
+	/* one frame per rx op with the latest content */
+	if (rxmsg.msg_head.opcode == RX_DIGEST &&
+	    rxmsg.msg_head.nframes == 2 &&
+	    nbytes == sizeof(struct bcm_msg_head) +
+		      2 * sizeof(struct can_frame) &&
+	    rxmsg.frame[0].can_id == 0x042 &&
+	    U64_DATA(&rxmsg.frame[0]) == 0x3333333333333333ULL &&
+	    rxmsg.frame[1].can_id == 0x043 &&
+	    U64_DATA(&rxmsg.frame[1]) == 0x2222222222222222ULL)
+		printf("<1>Received correct RX_DIGEST message >> OK!\n");
+	else {
+		printf("<1>Received unexpected message (opcode %d, %d frames):",
+		       rxmsg.msg_head.opcode, rxmsg.msg_head.nframes);
+		for (i = 0; i < rxmsg.msg_head.nframes && i < 4; i++)
+			printf(" %03X", rxmsg.frame[i].can_id);
+		printf("\n");
+	}
+
+	/* back to single RX_CHANGED messages */
+	ival.tv_sec = 0;
+	ival.tv_usec = 0;
+
+	if (setsockopt(s, SOL_CAN_BCM, CAN_BCM_RX_DIGEST,
+		       &ival, sizeof(ival)) < 0) {
+		perror("setsockopt CAN_BCM_RX_DIGEST");
+		return 1;
+	}
+
+	printf("<2>Writing TX_SEND for can_id <043>\n");
+	tx_send(s, 0x043, 0x4444444444444444ULL);
+
+	if ((nbytes = read(s, &rxmsg, sizeof(rxmsg))) < 0)
+		perror("read");
+
+	if (rxmsg.msg_head.opcode == RX_CHANGED &&
+	    nbytes == BCM_1FRAME_LEN &&
+	    rxmsg.msg_head.can_id == 0x043 && rxmsg.frame[0].can_id == 0x043)
+		printf("<2>Received correct RX_CHANGED message for can_id <%03X> >> OK!\n",
+		       rxmsg.frame[0].can_id);
+
+	close(s);
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# measure the filter processing costs in the PF_CAN rx path
+#
+# Runs tst-filter-master against tst-filter-server without load sockets,
+# with load sockets sharing one mask (different can_ids) and with load
+# sockets using distinct masks. Run it with the old and the new can.ko
+# loaded to get the before/after runtimes.
+#
+# usage: tst-filter-bench.sh [<loadsocks>]   (default: 200, needs vcan0)
+#
+# $Id$
+#
+
+LOADSOCKS=${1:-200}
+
+if ! ip link show vcan0 > /dev/null 2>&1
+then
+    echo vcan0 is needed for this test
+    exit 1
+fi
+
+for LOAD in "0 1" "$LOADSOCKS 1" "$LOADSOCKS $LOADSOCKS"
+do
+    set -- $LOAD
+
+    ./tst-filter-server $1 $2 > /dev/null &
+    SERVER=$!
+
+    # wait for the server to set up its sockets
+    sleep 1
+
+    echo -n "loadsocks $1 loadmasks $2: "
+    ./tst-filter-master | grep "Filtertest done"
+
+    wait $SERVER
+done
@@ -53,6 +53,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/time.h>
 #include <net/if.h>
 
 #include <linux/can.h>
@@ -68,6 +69,7 @@ int main(int argc, char **argv)
 	int nbytes;
 	struct ifreq ifr;
 	int ifindex;
+	struct timeval start, end;
 
 
 	if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
@@ -91,6 +93,8 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	gettimeofday(&start, NULL);
+
 	/* send testcases 0 .. 17 and a terminating 18 to quit */
 	for (testcase = 0; testcase < 19; testcase++) {
 
@@ -159,7 +163,12 @@ int main(int argc, char **argv)
 		printf("ok\n");
 	}
 
-	printf("Filtertest done.\n");
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &end);
+
+	/* compare with different loadfilters in tst-filter-server */
+	printf("Filtertest done (%ld.%06ld s).\n",
+	       (long)end.tv_sec, (long)end.tv_usec);
 
 	close(s);
 	return 0;
@@ -58,6 +58,23 @@
 #include <linux/can.h>
 #include <linux/can/raw.h>
 
+/*
+ * Usage: tst-filter-server [<loadsocks> [<loadmasks>]]
+ *
+ * The optional <loadsocks> value opens the given number of extra CAN_RAW
+ * sockets with one can_id/mask filter each. Every socket gets a distinct
+ * can_id. The sockets use <loadmasks> different masks (default: 1) in turn:
+ *
+ * tst-filter-server 200      => same mask, different can_ids (common case)
+ * tst-filter-server 200 200  => distinct masks (worst case)
+ *
+ * None of the filters matches the frames used in this test. Together with
+ * the runtime printed by tst-filter-master this allows to measure the filter
+ * processing costs in the PF_CAN rx path (see tst-filter-bench.sh).
+ * As filters with the same mask are grouped in the rx path, the costs
+ * depend on the number of different masks rather than on the filters.
+ */
+
 #define ID  0x123
 #define FIL 0x7FF
 #define EFF CAN_EFF_FLAG
@@ -94,14 +111,24 @@ int main(int argc, char **argv)
 {
 	fd_set rdfs;
 	int s, t;
+	int *u = NULL;
 	struct sockaddr_can addr;
 	struct can_filter rfilter;
+	struct can_filter lfilter;
 	struct can_frame frame;
 	int testcase = 0;
-	int nbytes, ret;
+	int loadsocks = 0;
+	int loadmasks = 1;
+	int nbytes, ret, i;
 	struct ifreq ifr;
 	int ifindex;
 
+	if (argc > 1)
+		loadsocks = atoi(argv[1]);
+	if (argc > 2)
+		loadmasks = atoi(argv[2]);
+	if (loadmasks < 1)
+		loadmasks = 1;
 
 	if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
 		perror("socket");
@@ -135,6 +162,34 @@ int main(int argc, char **argv)
 	/* disable default receive filter on the test socket */
 	setsockopt(t, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
 
+	if (loadsocks > 0) {
+		u = malloc(loadsocks * sizeof(int));
+		if (!u) {
+			perror("malloc");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < loadsocks; i++) {
+		if ((u[i] = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+			perror("socket");
+			return 1;
+		}
+
+		/* can_id bit 10 is always set => no match for test frames */
+		lfilter.can_mask = (0x7FF | ((i % loadmasks) << 11)) &
+			CAN_EFF_MASK;
+		lfilter.can_id   = 0x400 | (i & 0x3FF);
+
+		setsockopt(u[i], SOL_CAN_RAW, CAN_RAW_FILTER, &lfilter,
+			   sizeof(lfilter));
+
+		if (bind(u[i], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			perror("bind");
+			return 1;
+		}
+	}
+
 	while (1) {
 		
 		FD_ZERO(&rdfs);
@@ -206,6 +261,9 @@ int main(int argc, char **argv)
 
 	close(s);
 	close(t);
+	for (i = 0; i < loadsocks; i++)
+		close(u[i]);
+	free(u);
 
 	return 0;
 }
@@ -0,0 +1,269 @@
+/*
+ * tst-gw-ring.c - receive CAN frames from CAN_RING gateway jobs
+ *
+ * Sets up a userspace ring on the CAN gateway ring device, adds a
+ * CGW_TYPE_CAN_RING gateway job for each given source interface and
+ * prints the CAN frames that are delivered into the mmap'ed ring.
+ * The gateway jobs are removed by the kernel when the program terminates.
+ *
+ * Copyright (c) 2011 Volkswagen Group Electronic Research
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <socketcan-users@lists.berlios.de>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <net/if.h>
+
+#include <asm/types.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <socketcan/can.h>
+#include <socketcan/can/raw.h>
+#include <socketcan/can/gw.h>
+
+#define SLOTS 256
+
+#define NLMSG_TAIL(nmsg) \
+	((struct rtattr *)(((void *) (nmsg)) + NLMSG_ALIGN((nmsg)->nlmsg_len)))
+
+static int addattr_l(struct nlmsghdr *n, int maxlen, int type,
+		     const void *data, int alen)
+{
+	int len = RTA_LENGTH(alen);
+	struct rtattr *rta;
+
+	if (NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len) > maxlen)
+		return -1;
+
+	rta = NLMSG_TAIL(n);
+	rta->rta_type = type;
+	rta->rta_len = len;
+	memcpy(RTA_DATA(rta), data, alen);
+	n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len);
+	return 0;
+}
+
+/* add a CGW_TYPE_CAN_RING job for src_ifindex and check the netlink ack */
+static int add_ring_job(int s, __u32 src_ifindex, __u32 ring_id,
+			struct can_filter *filter)
+{
+	struct {
+		struct nlmsghdr n;
+		struct rtcanmsg r;
+		char buf[200];
+	} req;
+	char rxbuf[200];
+	struct nlmsghdr *nlh = (struct nlmsghdr *)rxbuf;
+	struct nlmsgerr *err;
+	struct sockaddr_nl nladdr;
+	int len;
+
+	memset(&req, 0, sizeof(req));
+
+	req.n.nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+	req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req.n.nlmsg_type  = RTM_NEWROUTE;
+
+	req.r.can_family  = AF_CAN;
+	req.r.gwtype      = CGW_TYPE_CAN_RING;
+
+	addattr_l(&req.n, sizeof(req), CGW_SRC_IF, &src_ifindex,
+		  sizeof(src_ifindex));
+	addattr_l(&req.n, sizeof(req), CGW_RING_ID, &ring_id,
+		  sizeof(ring_id));
+	if (filter)
+		addattr_l(&req.n, sizeof(req), CGW_FILTER, filter,
+			  sizeof(*filter));
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+
+	if (sendto(s, &req, req.n.nlmsg_len, 0,
+		   (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		perror("netlink sendto");
+		return 1;
+	}
+
+	len = recv(s, rxbuf, sizeof(rxbuf), 0);
+	if (len < 0) {
+		perror("netlink recv");
+		return 1;
+	}
+
+	if (!NLMSG_OK(nlh, len) || nlh->nlmsg_type != NLMSG_ERROR) {
+		fprintf(stderr, "unexpected netlink answer\n");
+		return 1;
+	}
+
+	err = NLMSG_DATA(nlh);
+	if (err->error) {
+		fprintf(stderr, "adding ring job failed: %s\n",
+			strerror(-err->error));
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct can_raw_ring_slot *ring;
+	struct can_raw_ring_slot *slot;
+	struct cgw_ring_req rreq;
+	struct can_filter filter, *fp = NULL;
+	struct pollfd pfd;
+	unsigned int idx = 0;
+	unsigned int drops = 0;
+	size_t size;
+	__u32 ifindex;
+	int fd, s;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "f:")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (sscanf(optarg, "%x:%x", &filter.can_id,
+				   &filter.can_mask) != 2) {
+				fprintf(stderr, "invalid filter '%s'\n",
+					optarg);
+				return 1;
+			}
+			fp = &filter;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-f <can_id>:<can_mask>] "
+				"<ifname> [<ifname> ...]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc) {
+		fprintf(stderr, "Usage: %s [-f <can_id>:<can_mask>] "
+			"<ifname> [<ifname> ...]\n", argv[0]);
+		return 1;
+	}
+
+	fd = open(CGW_RING_DEV, O_RDWR);
+	if (fd < 0) {
+		perror("open " CGW_RING_DEV);
+		return 1;
+	}
+
+	rreq.slot_nr = SLOTS;
+	rreq.ring_id = 0;
+	if (ioctl(fd, CGW_RING_SETUP, &rreq) < 0) {
+		perror("ioctl CGW_RING_SETUP");
+		return 1;
+	}
+
+	size = SLOTS * sizeof(*ring);
+	size = (size + getpagesize() - 1) & ~(getpagesize() - 1);
+
+	ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	printf("ring id %u with %d slots\n", rreq.ring_id, SLOTS);
+
+	s = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (s < 0) {
+		perror("netlink socket");
+		return 1;
+	}
+
+	for (i = optind; i < argc; i++) {
+		ifindex = if_nametoindex(argv[i]);
+		if (!ifindex) {
+			fprintf(stderr, "unknown interface '%s'\n", argv[i]);
+			return 1;
+		}
+		if (add_ring_job(s, ifindex, rreq.ring_id, fp))
+			return 1;
+	}
+
+	close(s);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+
+	while (1) {
+		slot = &ring[idx];
+
+		if (slot->status == CAN_RAW_SLOT_KERNEL) {
+			if (poll(&pfd, 1, -1) < 0) {
+				perror("poll");
+				return 1;
+			}
+			continue;
+		}
+
+		/* read the slot content after the slot status */
+		__sync_synchronize();
+
+		if (slot->drops != drops) {
+			printf("%u frames dropped\n", slot->drops - drops);
+			drops = slot->drops;
+		}
+
+		printf("(%u.%06u) %d %03X [%d]", slot->bf.tv_sec,
+		       slot->bf.tv_usec, slot->bf.ifindex,
+		       slot->bf.frame.can_id, slot->bf.frame.can_dlc);
+		for (i = 0; i < slot->bf.frame.can_dlc && i < 8; i++)
+			printf(" %02X", slot->bf.frame.data[i]);
+		printf("\n");
+
+		/* hand back the slot to the kernel */
+		__sync_synchronize();
+		slot->status = CAN_RAW_SLOT_KERNEL;
+
+		if (++idx >= SLOTS)
+			idx = 0;
+	}
+
+	return 0;
+}
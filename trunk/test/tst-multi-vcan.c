@@ -0,0 +1,193 @@
+/*
+ *  $Id$
+ */
+
+/*
+ * tst-multi-vcan.c - rx path benchmark with many CAN interfaces
+ *
+ * Copyright (c) 2012 Volkswagen Group Electronic Research
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <socketcan-users@lists.berlios.de>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <libgen.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <net/if.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#define MAXIF 64
+
+void print_usage(char *prg)
+{
+	fprintf(stderr, "\nUsage: %s [options] <CAN interface>+\n", prg);
+	fprintf(stderr, "Options: -n <frames> (frames per interface - default 10000)\n");
+	fprintf(stderr, "\nSends CAN frames round robin on all given interfaces and reads\n");
+	fprintf(stderr, "each frame back from a socket bound to the sending interface.\n");
+	fprintf(stderr, "E.g. create 32 vcan interfaces and compare the results for the\n");
+	fprintf(stderr, "first and the last created interface with many interfaces present.\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	int s[MAXIF];
+	int ifindex[MAXIF];
+	int numif;
+	int frames = 10000;
+	int tx;
+	int opt, i, n;
+	struct sockaddr_can addr;
+	struct can_filter rfilter;
+	struct can_frame frame;
+	struct ifreq ifr;
+	struct timeval start, end;
+	double secs;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = atoi(optarg);
+			break;
+
+		default:
+			print_usage(basename(argv[0]));
+			exit(1);
+			break;
+		}
+	}
+
+	numif = argc - optind;
+
+	if (numif < 1 || numif > MAXIF || frames < 1) {
+		print_usage(basename(argv[0]));
+		exit(1);
+	}
+
+	/* the tx socket is bound to all CAN interfaces and uses sendto() */
+	if ((tx = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	setsockopt(tx, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0);
+
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = 0;
+
+	if (bind(tx, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	rfilter.can_id   = 0x123;
+	rfilter.can_mask = CAN_SFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+
+	for (i = 0; i < numif; i++) {
+		strncpy(ifr.ifr_name, argv[optind + i], IFNAMSIZ);
+		if (ioctl(tx, SIOCGIFINDEX, &ifr) < 0) {
+			perror("SIOCGIFINDEX");
+			return 1;
+		}
+		ifindex[i] = ifr.ifr_ifindex;
+
+		if ((s[i] = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+			perror("socket");
+			return 1;
+		}
+
+		setsockopt(s[i], SOL_CAN_RAW, CAN_RAW_FILTER,
+			   &rfilter, sizeof(rfilter));
+
+		addr.can_ifindex = ifindex[i];
+
+		if (bind(s[i], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			perror("bind");
+			return 1;
+		}
+	}
+
+	frame.can_id  = 0x123;
+	frame.can_dlc = 8;
+	memset(frame.data, 0x55, 8);
+
+	gettimeofday(&start, NULL);
+
+	for (n = 0; n < frames; n++) {
+		for (i = 0; i < numif; i++) {
+
+			addr.can_ifindex = ifindex[i];
+
+			if (sendto(tx, &frame, sizeof(frame), 0,
+				   (struct sockaddr *)&addr,
+				   sizeof(addr)) != sizeof(frame)) {
+				perror("sendto");
+				return 1;
+			}
+
+			if (read(s[i], &frame, sizeof(frame)) != sizeof(frame)) {
+				perror("read");
+				return 1;
+			}
+		}
+	}
+
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &end);
+
+	secs = end.tv_sec + end.tv_usec / 1000000.0;
+
+	printf("%d frames on %d interface(s) in %ld.%06ld s (%.0f frames/s)\n",
+	       frames * numif, numif, end.tv_sec, end.tv_usec,
+	       secs > 0 ? frames * numif / secs : 0);
+
+	for (i = 0; i < numif; i++)
+		close(s[i]);
+
+	close(tx);
+
+	return 0;
+}
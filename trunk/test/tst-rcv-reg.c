@@ -0,0 +1,227 @@
+/*
+ *  $Id$
+ */
+
+/*
+ * tst-rcv-reg.c - stress test for the CAN receive list (un)registration
+ *
+ * Copyright (c) 2012 Volkswagen Group Electronic Research
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <socketcan-users@lists.berlios.de>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <libgen.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <net/if.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#define MAXIF 32
+#define MAXSOCK 1024
+
+void print_usage(char *prg)
+{
+	fprintf(stderr, "\nUsage: %s [options] <CAN interface>+\n", prg);
+	fprintf(stderr, "Options: -p <procs>   (number of processes - default 8)\n");
+	fprintf(stderr, "         -n <sockets> (sockets per process and round - default 250)\n");
+	fprintf(stderr, "         -r <rounds>  (open/close rounds per process - default 10)\n");
+	fprintf(stderr, "\nEach process opens the sockets on one of the given interfaces with\n");
+	fprintf(stderr, "different filters (single SFF/EFF can_ids and can_id/mask filters)\n");
+	fprintf(stderr, "and closes them again. Check /proc/net/can/stats afterwards.\n\n");
+}
+
+/* filter types: single SFF id, single EFF id, can_id/mask filter */
+void set_filter(struct can_filter *rfilter, int proc, int n)
+{
+	switch (n % 3) {
+
+	case 0:
+		rfilter->can_id   = (proc * MAXSOCK + n) & CAN_SFF_MASK;
+		rfilter->can_mask = CAN_SFF_MASK | CAN_EFF_FLAG;
+		break;
+
+	case 1:
+		rfilter->can_id   = ((proc * MAXSOCK + n) | CAN_EFF_FLAG);
+		rfilter->can_mask = CAN_EFF_MASK | CAN_EFF_FLAG;
+		break;
+
+	default:
+		rfilter->can_id   = n & 0x7F0;
+		rfilter->can_mask = 0x7F0;
+		break;
+	}
+}
+
+int worker(int proc, int ifindex, int numsock, int rounds)
+{
+	int s[MAXSOCK];
+	struct sockaddr_can addr;
+	struct can_filter rfilter;
+	int i, r;
+
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifindex;
+
+	for (r = 0; r < rounds; r++) {
+
+		for (i = 0; i < numsock; i++) {
+			if ((s[i] = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+				perror("socket");
+				return 1;
+			}
+
+			set_filter(&rfilter, proc, i);
+			setsockopt(s[i], SOL_CAN_RAW, CAN_RAW_FILTER,
+				   &rfilter, sizeof(rfilter));
+
+			if (bind(s[i], (struct sockaddr *)&addr,
+				 sizeof(addr)) < 0) {
+				perror("bind");
+				return 1;
+			}
+		}
+
+		for (i = 0; i < numsock; i++)
+			close(s[i]);
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ifindex[MAXIF];
+	int numif;
+	int procs = 8;
+	int numsock = 250;
+	int rounds = 10;
+	int opt, i, status;
+	int failed = 0;
+	pid_t pid;
+	struct ifreq ifr;
+	struct timeval start, end;
+	int s;
+
+	while ((opt = getopt(argc, argv, "p:n:r:")) != -1) {
+		switch (opt) {
+		case 'p':
+			procs = atoi(optarg);
+			break;
+
+		case 'n':
+			numsock = atoi(optarg);
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+
+		default:
+			print_usage(basename(argv[0]));
+			exit(1);
+			break;
+		}
+	}
+
+	numif = argc - optind;
+
+	if (numif < 1 || numif > MAXIF || procs < 1 ||
+	    numsock < 1 || numsock > MAXSOCK || rounds < 1) {
+		print_usage(basename(argv[0]));
+		exit(1);
+	}
+
+	if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	for (i = 0; i < numif; i++) {
+		strncpy(ifr.ifr_name, argv[optind + i], IFNAMSIZ);
+		if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+			perror("SIOCGIFINDEX");
+			return 1;
+		}
+		ifindex[i] = ifr.ifr_ifindex;
+	}
+
+	close(s);
+
+	printf("%d processes open/close %d sockets %d times on %d interface(s) ... ",
+	       procs, numsock, rounds, numif);
+	fflush(stdout);
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < procs; i++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid)
+			exit(worker(i, ifindex[i % numif], numsock, rounds));
+	}
+
+	while (wait(&status) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+
+	gettimeofday(&end, NULL);
+	timersub(&end, &start, &end);
+
+	if (failed) {
+		printf("%d process(es) failed!\n", failed);
+		return 1;
+	}
+
+	printf("done (%ld.%06ld s).\n", end.tv_sec, end.tv_usec);
+
+	return 0;
+}